@@ -0,0 +1,196 @@
+#!/bin/sh
+#-
+# Copyright (c) 2017 Dag-Erling Smørgrav
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+
+#
+# Run each engine across a range of log2max values, several times each,
+# and summarize throughput, peak memory and scaling.
+#
+
+progname=collatz-bench
+collatz=${COLLATZ:-@bindir@/collatz}
+engines="recursive iterative"
+min=16
+max=22
+repeat=5
+raw=
+
+usage() {
+	echo "usage: $progname [-c collatz] [-e engines] [-m min] [-M max] [-n repeat] [-o raw.csv]" >&2
+	exit 1
+}
+
+error() {
+	echo "$progname: $*" >&2
+	exit 1
+}
+
+#
+# Command-line options for each engine.
+#
+engine_flags() {
+	case $1 in
+	recursive)
+		echo ""
+		;;
+	iterative)
+		echo "-i"
+		;;
+	forward)
+		echo "-f"
+		;;
+	delay)
+		echo "-D"
+		;;
+	path)
+		echo "-P"
+		;;
+	splay)
+		echo "-B splay"
+		;;
+	splay-i)
+		echo "-i -B splay"
+		;;
+	lsm)
+		echo "-B lsm"
+		;;
+	lsm-i)
+		echo "-i -B lsm"
+		;;
+	bitmap)
+		echo "-B bitmap"
+		;;
+	bitmap-i)
+		echo "-i -B bitmap"
+		;;
+	*)
+		error "unknown engine: $1"
+		;;
+	esac
+}
+
+#
+# Extract a numeric field from a JSON report.
+#
+field() {
+	sed -n "s/^  \"$1\": \\([0-9.]*\\),*\$/\\1/p" "$2"
+}
+
+while getopts "c:e:m:M:n:o:" opt ; do
+	case $opt in
+	c)
+		collatz=$OPTARG
+		;;
+	e)
+		engines=$(echo "$OPTARG" | tr ',' ' ')
+		;;
+	m)
+		min=$OPTARG
+		;;
+	M)
+		max=$OPTARG
+		;;
+	n)
+		repeat=$OPTARG
+		;;
+	o)
+		raw=$OPTARG
+		;;
+	*)
+		usage
+		;;
+	esac
+done
+shift $((OPTIND - 1))
+[ $# -eq 0 ] || usage
+[ -x "$collatz" ] || error "$collatz not found"
+[ "$min" -le "$max" ] || usage
+[ "$repeat" -ge 1 ] || usage
+for engine in $engines ; do
+	engine_flags $engine >/dev/null
+done
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/$progname.XXXXXX") ||
+	error "failed to create temporary directory"
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+#
+# Run everything, collecting one CSV line per run.
+#
+echo "engine,log2max,run,wall,user,system,visited,covered,max_nodes,peak_rss" >"$tmp/raw.csv"
+for engine in $engines ; do
+	flags=$(engine_flags $engine)
+	log2max=$min
+	while [ $log2max -le $max ] ; do
+		run=1
+		while [ $run -le $repeat ] ; do
+			echo "$engine $log2max $run/$repeat" >&2
+			"$collatz" $flags -j "$tmp/report.json" $log2max >/dev/null ||
+				error "$engine $log2max failed"
+			echo "$engine,$log2max,$run,$(field wall_time "$tmp/report.json"),$(field user_time "$tmp/report.json"),$(field system_time "$tmp/report.json"),$(field visited "$tmp/report.json"),$(field covered "$tmp/report.json"),$(field max_nodes "$tmp/report.json"),$(field peak_rss "$tmp/report.json")" >>"$tmp/raw.csv"
+			run=$((run + 1))
+		done
+		log2max=$((log2max + 1))
+	done
+done
+[ -z "$raw" ] || cp "$tmp/raw.csv" "$raw"
+
+#
+# Summarize: median and minimum wall time, throughput based on the
+# median, peak memory, and the growth in median time from the previous
+# log2max, which should approach 2 for an engine that scales linearly.
+#
+tail -n +2 "$tmp/raw.csv" | sort -t, -k1,1 -k2,2n -k4,4n | awk -F, '
+function flush() {
+	if (n == 0)
+		return
+	med = n % 2 ? w[(n + 1) / 2] : (w[n / 2] + w[n / 2 + 1]) / 2
+	growth = (prev_engine == engine && prev > 0) ? sprintf("%.2f", med / prev) : "-"
+	rate = med > 0 ? visited / med : 0
+	printf "%-10s %7d %10.3f %10.3f %12.0f %10.1f %12d %7s\n", engine, log2max, med, w[1], rate, rss / 1048576, nodes, growth
+	prev = med
+	prev_engine = engine
+	n = 0
+}
+$1 != engine || $2 != log2max {
+	flush()
+	engine = $1
+	log2max = $2
+	rss = nodes = 0
+}
+{
+	w[++n] = $4
+	visited = $7
+	if ($10 > rss)
+		rss = $10
+	if ($9 > nodes)
+		nodes = $9
+}
+BEGIN {
+	printf "%-10s %7s %10s %10s %12s %10s %12s %7s\n", "engine", "log2max", "median s", "min s", "numbers/s", "rss MiB", "max nodes", "growth"
+}
+END { flush() }
+'
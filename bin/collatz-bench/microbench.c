@@ -0,0 +1,449 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <collatz/cover.h>
+#include <collatz/tree.h>
+
+/*
+ * Microbenchmarks for the coverage backends
+ *
+ * Each pattern is a deterministic sequence of numbers generated on the
+ * fly, so that sizes far beyond what would fit in memory as an array
+ * can be tested.  For each pattern and size, we measure:
+ *
+ *  - insert: inserting every number into an empty tree
+ *  - lookup: looking up every number, then as many random numbers
+ *  - batched: the same lookups, LOOKUP_BATCH at a time, if the
+ *    backend supports it
+ *  - coalesce: inserting the successor of every number, which merges
+ *    neighbouring ranges wherever the gap was a single number
+ *  - teardown: destroying the tree, per node destroyed, or per set for
+ *    backends without nodes
+ *
+ * Backends which defer work until flushed are flushed at the end of
+ * each insert and coalesce pass, and the flush is included in its time.
+ *
+ * Note that the interval tree does not rebalance, so the sequential
+ * pattern degenerates into a list and takes quadratic time.  So does
+ * the doubling pattern, whose chains are started in ascending order,
+ * to a lesser degree.  They are therefore only run if explicitly
+ * requested.
+ */
+
+typedef enum pattern {
+	PAT_SEQUENTIAL,		/* odd numbers in ascending order */
+	PAT_RANDOM,		/* uniformly distributed */
+	PAT_DOUBLING,		/* short doubling chains */
+	PAT_COLLATZ,		/* breadth-first reverse Collatz traversal */
+	PAT_NPATTERNS
+} pattern;
+
+static const char *pattern_name[PAT_NPATTERNS] = {
+	"sequential", "random", "doubling", "collatz",
+};
+
+/* number of descents in flight in the batched lookup */
+#define LOOKUP_BATCH		16
+
+/* highest number per number for backends with a limit */
+#define SPARSE_MAX		4096
+
+/* length of each doubling chain */
+#define DOUBLING_CHAIN		8
+
+/*
+ * Bounds on the reverse Collatz traversal: numbers whose double would
+ * wrap are not doubled, and once the queue reaches its maximum size,
+ * new numbers are dropped.  Either way, every number still has at
+ * least one successor most of the time, so the sequence does not run
+ * dry, and it remains free of repeats.
+ */
+#define COLLATZ_MAX		(UINTMAX_MAX / 2)
+#define COLLATZ_QUEUE_MAX	(1<<24)
+
+typedef struct generator {
+	pattern		 pat;
+	uintmax_t	 n;		/* numbers to generate */
+	uintmax_t	 i;		/* numbers generated so far */
+	uint64_t	 state;		/* PRNG state */
+	uintmax_t	 seed;		/* current chain seed */
+	unsigned int	 chain;		/* position in the chain */
+	uintmax_t	*queue;		/* BFS queue */
+	size_t		 qsize, qr, qw;
+} generator;
+
+static uint64_t seed = 0x9e3779b97f4a7c15ULL;
+static const cover_ops *cover;
+
+/*
+ * xorshift64* PRNG.
+ */
+static inline uint64_t
+prng(uint64_t *state)
+{
+	uint64_t x;
+
+	x = *state;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	return (x * 0x2545f4914f6cdd1dULL);
+}
+
+static void
+gen_queue(generator *g, uintmax_t num)
+{
+
+	if (g->qw - g->qr == g->qsize) {
+		if (g->qsize >= COLLATZ_QUEUE_MAX)
+			return;
+		/* full, double the size and unwrap */
+		if ((g->queue = realloc(g->queue,
+		    2 * g->qsize * sizeof *g->queue)) == NULL)
+			err(1, "realloc()");
+		memcpy(g->queue + g->qsize, g->queue,
+		    (g->qw % g->qsize) * sizeof *g->queue);
+		g->qr %= g->qsize;
+		g->qw = g->qr + g->qsize;
+		g->qsize *= 2;
+	}
+	g->queue[g->qw++ % g->qsize] = num;
+}
+
+static void
+gen_init(generator *g, pattern pat, uintmax_t n)
+{
+
+	memset(g, 0, sizeof *g);
+	g->pat = pat;
+	g->n = n;
+	g->state = seed;
+	g->seed = 1;
+	if (pat == PAT_COLLATZ) {
+		g->qsize = 1024;
+		if ((g->queue = malloc(g->qsize * sizeof *g->queue)) == NULL)
+			err(1, "malloc()");
+		/* 1, 2 and 4 form a cycle; start below it */
+		gen_queue(g, 8);
+	}
+}
+
+static void
+gen_fini(generator *g)
+{
+
+	free(g->queue);
+	g->queue = NULL;
+}
+
+/*
+ * Returns the next number in the sequence, or 0 when done.
+ */
+static uintmax_t
+gen_next(generator *g)
+{
+	uintmax_t num;
+
+	if (g->i == g->n)
+		return (0);
+	g->i++;
+	switch (g->pat) {
+	case PAT_SEQUENTIAL:
+		return (2 * g->i - 1);
+	case PAT_RANDOM:
+		return (prng(&g->state) % (4 * g->n) + 1);
+	case PAT_DOUBLING:
+		num = g->seed << g->chain;
+		if (++g->chain == DOUBLING_CHAIN) {
+			g->chain = 0;
+			g->seed += 2;
+		}
+		return (num);
+	case PAT_COLLATZ:
+		/* the reverse graph is a tree, so no number recurs */
+		num = g->queue[g->qr++ % g->qsize];
+		if (num <= COLLATZ_MAX)
+			gen_queue(g, num * 2);
+		if ((num - 1) % 6 == 3)
+			gen_queue(g, (num - 1) / 3);
+		return (num);
+	default:
+		abort();
+	}
+}
+
+/*
+ * Returns the largest number in the sequence.
+ */
+static uintmax_t
+gen_max(pattern pat, uintmax_t n)
+{
+	generator g;
+	uintmax_t num, max;
+
+	gen_init(&g, pat, n);
+	for (max = 0; (num = gen_next(&g)) != 0; )
+		if (num > max)
+			max = num;
+	gen_fini(&g);
+	return (max);
+}
+
+static double
+now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+/*
+ * Run all five benchmarks once for a given pattern and size and add
+ * the elapsed time of each to the totals.
+ */
+static void
+bench(pattern pat, uintmax_t n, double t[5], uintmax_t *torn,
+    unsigned int *maxn, unsigned int *maxd)
+{
+	generator g;
+	uint64_t state;
+	uintmax_t num, hits, nums[LOOKUP_BATCH];
+	bool found[LOOKUP_BATCH];
+	unsigned int i, k;
+	void *set;
+	double start;
+
+	nodes = maxnodes = maxdepth = 0;
+	gen_init(&g, pat, n);
+	num = gen_next(&g);
+	set = cover->init(num, num, 0);
+	start = now();
+	while ((num = gen_next(&g)) != 0)
+		(void)cover->insert(set, num, num);
+	if (cover->flush != NULL)
+		cover->flush(set);
+	t[0] += now() - start;
+	gen_fini(&g);
+
+	hits = 0;
+	gen_init(&g, pat, n);
+	state = seed ^ 0x5555555555555555ULL;
+	start = now();
+	while ((num = gen_next(&g)) != 0) {
+		hits += cover->lookup(set, num);
+		hits += cover->lookup(set,
+		    prng(&state) % cover->highest(set) + 1);
+	}
+	t[1] += now() - start;
+	gen_fini(&g);
+	if (hits < n)
+		errx(1, "%s: only %ju of %ju numbers found",
+		    pattern_name[pat], hits, n);
+
+	if (cover->lookup_batch != NULL) {
+		hits = 0;
+		gen_init(&g, pat, n);
+		state = seed ^ 0x5555555555555555ULL;
+		start = now();
+		do {
+			for (k = 0; k < LOOKUP_BATCH &&
+			    (num = gen_next(&g)) != 0; k += 2) {
+				nums[k] = num;
+				nums[k + 1] =
+				    prng(&state) % cover->highest(set) + 1;
+			}
+			cover->lookup_batch(set, nums, found, k);
+			for (i = 0; i < k; ++i)
+				hits += found[i];
+		} while (k == LOOKUP_BATCH);
+		t[2] += now() - start;
+		gen_fini(&g);
+		if (hits < n)
+			errx(1, "%s: only %ju of %ju numbers found in batches",
+			    pattern_name[pat], hits, n);
+	}
+
+	gen_init(&g, pat, n);
+	start = now();
+	while ((num = gen_next(&g)) != 0)
+		(void)cover->insert(set, num + 1, num + 1);
+	if (cover->flush != NULL)
+		cover->flush(set);
+	t[3] += now() - start;
+	gen_fini(&g);
+
+	if (maxnodes > *maxn)
+		*maxn = maxnodes;
+	if (maxdepth > *maxd)
+		*maxd = maxdepth;
+	*torn += nodes;
+	start = now();
+	cover->destroy(set);
+	t[4] += now() - start;
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: collatz-microbench [-B backend] [-m min] "
+	    "[-M max] [-n repeat]\n"
+	    "                          [-p pattern[,...]] [-s seed]\n"
+	    "sizes range from 10^min to 10^max, 1 <= min <= max <= 9\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	static const char *opname[5] = {
+		"insert", "lookup", "batched", "coalesce", "teardown",
+	};
+	bool patterns[PAT_NPATTERNS];
+	unsigned long min, max, repeat;
+	unsigned int maxn, maxd, i, j, k;
+	uintmax_t n, m, ops, torn;
+	double t[5];
+	char nbuf[16], *p, *e;
+	int opt;
+
+	min = 3;
+	max = 6;
+	repeat = 3;
+	for (i = 0; i < PAT_NPATTERNS; ++i)
+		patterns[i] = i != PAT_SEQUENTIAL && i != PAT_DOUBLING;
+	while ((opt = getopt(argc, argv, "B:m:M:n:p:s:")) != -1)
+		switch (opt) {
+		case 'B':
+			if ((cover = cover_select(optarg)) == NULL)
+				errx(1, "%s: no such backend", optarg);
+			break;
+		case 'm':
+			min = strtoul(optarg, &e, 10);
+			if (*optarg == '\0' || *e != '\0')
+				usage();
+			break;
+		case 'M':
+			max = strtoul(optarg, &e, 10);
+			if (*optarg == '\0' || *e != '\0')
+				usage();
+			break;
+		case 'n':
+			repeat = strtoul(optarg, &e, 10);
+			if (*optarg == '\0' || *e != '\0' || repeat == 0)
+				usage();
+			break;
+		case 'p':
+			memset(patterns, 0, sizeof patterns);
+			while ((p = strsep(&optarg, ",")) != NULL) {
+				for (i = 0; i < PAT_NPATTERNS; ++i)
+					if (strcmp(p, pattern_name[i]) == 0)
+						break;
+				if (i == PAT_NPATTERNS)
+					errx(1, "unknown pattern: %s", p);
+				patterns[i] = true;
+			}
+			break;
+		case 's':
+			seed = strtoull(optarg, &e, 0);
+			if (*optarg == '\0' || *e != '\0' || seed == 0)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	argc -= optind;
+	argv += optind;
+	if (argc > 0 || min < 1 || max > 9 || min > max)
+		usage();
+	if (cover == NULL)
+		cover = cover_select("tree");
+
+	printf("%-10s %11s %-9s %10s %10s %10s %9s\n", "pattern", "size",
+	    "op", "ns/op", "Mops/s", "max nodes", "max depth");
+	for (i = 0; i < PAT_NPATTERNS; ++i) {
+		if (!patterns[i])
+			continue;
+		for (n = 1, k = 0; k < min; ++k)
+			n *= 10;
+		for (; k <= max; ++k, n *= 10) {
+			/*
+			 * A backend with a limit, i.e. the bitmap, uses
+			 * memory in proportion to the highest number rather
+			 * than to how many there are, so skip patterns which
+			 * are far too sparse for it.  The coalesce pass
+			 * inserts successors, hence >=.
+			 */
+			if (cover->limit < UINTMAX_MAX &&
+			    ((m = gen_max(i, n)) >= cover->limit ||
+			    m / SPARSE_MAX > n)) {
+				printf("%-10s %11ju too sparse for the %s "
+				    "backend\n", pattern_name[i], n, cover->name);
+				break;
+			}
+			memset(t, 0, sizeof t);
+			maxn = maxd = 0;
+			torn = 0;
+			for (j = 0; j < repeat; ++j)
+				bench(i, n, t, &torn, &maxn, &maxd);
+			for (j = 0; j < 5; ++j) {
+				if (j == 2 && cover->lookup_batch == NULL)
+					continue;
+				/* lookups are twice as many as inserts */
+				ops = j == 1 || j == 2 ? 2 * n * repeat :
+				    j != 4 ? n * repeat :
+				    cover->bytes != NULL ? repeat : torn;
+				if (ops == 0)
+					ops = 1;
+				if (cover->bytes != NULL)
+					snprintf(nbuf, sizeof nbuf, "-");
+				else
+					snprintf(nbuf, sizeof nbuf, "%u", maxn);
+				printf("%-10s %11ju %-9s %10.1f %10.2f %10s %9u\n",
+				    pattern_name[i], n, opname[j],
+				    t[j] * 1e9 / ops, ops / t[j] / 1e6,
+				    nbuf, maxd);
+			}
+			fflush(stdout);
+		}
+	}
+	exit(0);
+}
@@ -0,0 +1,73 @@
+#!/bin/sh
+#-
+# Copyright (c) 2017 Dag-Erling Smørgrav
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+#
+
+#
+# Regression test for the interval tree: compare the ranges reported by
+# each engine with a brute-force computation of the numbers below the
+# stop whose trajectory stays below it.  Coalescing used to bridge the
+# gaps between leaves as well as the one it was asked to fill, so the
+# tree claimed numbers which were never reached.
+#
+
+collatz=${COLLATZ:-./collatz}
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/coalesce.XXXXXX") || exit 1
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+expected() {
+	awk -v stop=$((1 << $1)) '
+	BEGIN {
+		first = 0
+		for (n = 1; n < stop; n++) {
+			for (x = n; x != 1 && x < stop; )
+				x = x % 2 ? 3 * x + 1 : x / 2
+			if (x == 1) {
+				if (first == 0)
+					first = n
+			} else if (first != 0) {
+				printf "[%d, %d]\n", first, n - 1
+				first = 0
+			}
+		}
+		if (first != 0)
+			printf "[%d, %d]\n", first, stop - 1
+	}'
+}
+
+ret=0
+for log2max in 4 6 8 10 12 ; do
+	expected $log2max >"$tmp/expected"
+	for flags in "" "-i" ; do
+		"$collatz" $flags -v $log2max >"$tmp/actual" 2>/dev/null ||
+			{ echo "collatz $flags $log2max failed" ; ret=1 ; continue ; }
+		if ! cmp -s "$tmp/expected" "$tmp/actual" ; then
+			echo "collatz $flags $log2max: wrong ranges"
+			diff "$tmp/expected" "$tmp/actual" | head -5
+			ret=1
+		fi
+	done
+done
+exit $ret
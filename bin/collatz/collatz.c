@@ -28,9 +28,16 @@
 #include "config.h"
 #endif
 
+#include <sys/resource.h>
+
 #include <assert.h>
 #include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -39,13 +46,42 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <collatz/delay.h>
+#include <collatz/cover.h>
+#include <collatz/forward.h>
+#include <collatz/map.h>
+#include <collatz/tree.h>
+
+#include "itrace.h"
+#include "perf.h"
+#include "trace.h"
+
 static uintmax_t stop = (uintmax_t)1 << 30;
 
 static bool opt_d;
+static bool opt_D;
+static bool opt_e;
+static bool opt_f;
+static bool opt_F;
 static bool opt_i;
+static bool opt_P;
 static bool opt_v;
 
+static map cmap = { 3, 1 };
+
 static bool tty;
+static FILE *tsf;
+static FILE *jsf;
+static FILE *trf;
+static itrace itw, itr;
+static const char *replay;
+static const char *kernel_name;
+static unsigned int nthreads;
+static unsigned int cache_bits = DELAY_CACHE_BITS;
+static const char *cache_path;
+
+/* events per thread in the trace */
+#define TRACE_EVENTS		(1<<16)
 
 #define debug(...) \
 	do { if (opt_d) fprintf(stderr, __VA_ARGS__); } while (0)
@@ -56,333 +92,670 @@ static bool tty;
 #define MAX(a, b)	((a) > (b) ? (a) : (b))
 
 /*
- * Tree of reachable numbers
+ * The set of reached numbers, and the backend which implements it
+ */
+static const cover_ops *cover;
+static void *cset;
+
+/*
+ * Work queue, grown as needed
+ */
+#define WORKQUEUE_SIZE		(1<<20)
+static uintmax_t *queue;
+static size_t qsize, qlen, qr, qw;
+
+/*
+ * Statistics
+ */
+static unsigned int maxrecurse;
+static size_t maxqueue;
+static uintmax_t nfound, nbeyond;
+static double wall;
+
+/*
+ * BFS levels, i.e. the number of steps from 1.  The recursive engine's
+ * depth is the level of the number it is looking at; the iterative
+ * engine keeps track of where each level ends in its queue.
+ */
+struct level {
+	uintmax_t	 numbers;	/* new numbers */
+	uintmax_t	 beyond;	/* numbers beyond the stop */
+	uintmax_t	 intervals;	/* intervals once the level was done */
+};
+static struct level *levels;
+static unsigned int nlevels, levels_size;
+static size_t frame_bytes;
+
+/*
+ * Memory projection.  Empirically, the iterative engine's work queue
+ * peaks at about 0.5% of the stop; the backends project their own.
  */
-typedef struct node {
+#define PROJECTED_QUEUE(stop)	((stop) / 200)
+
+/*
+ * Forward verification: the kernel in use, its results so far, and the
+ * number of consecutive numbers handed to it at a time.
+ */
+static const fwd_kernel_desc *kernel;
+static fwd_result fwd;
+#define FORWARD_CHUNK		(1<<16)
+#define KERNEL_NAME		(map_classic(&cmap) ? kernel->name : "generic")
+
+/* engines which do not build a tree */
+#define TREELESS		(opt_f || opt_D || opt_P || query_path != NULL)
+
+/*
+ * Whether to record the number of intervals at each level, which only
+ * the iterative engine can do and only some backends know cheaply.
+ */
+#define LEVEL_INTERVALS		(opt_i && cover->intervals != NULL)
+
+/*
+ * Record search.  Workers claim chunks of consecutive numbers in order,
+ * and collect the numbers which set a record within their chunk.  The
+ * chunks are merged in order through a window of RECORD_WINDOW slots
+ * per thread, so only those candidates which beat every smaller number
+ * are reported, and a worker which gets too far ahead of the merge
+ * waits for it to catch up.
+ */
+struct record {
+	uintmax_t	 n;
+	unsigned __int128 value;	/* delay or peak */
+};
+
+struct chunk {
 	uintmax_t	 first;
 	uintmax_t	 last;
-	uintmax_t	 covered;
-	unsigned int	 depth;
-	struct node	*left;
-	struct node	*right;
-} node;
+	bool		 done;
+	struct record	*recs;		/* candidates */
+	size_t		 nrecs;
+	size_t		 size;
+	uint16_t	*delays;	/* for the table, if any */
+};
 
-#define LEAF_NODE(n)	((n)->left == NULL && (n)->right == NULL)
+#define RECORD_CHUNK		(1<<16)
+#define RECORD_WINDOW		4
+static void (*record_scan)(struct chunk *);
+static struct chunk *window;
+static size_t nslots;
+static uintmax_t nchunks, nextchunk, merged;
+static pthread_mutex_t records_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t records_cv = PTHREAD_COND_INITIALIZER;
+static struct record *records;
+static size_t nrecords, records_size;
 
-static node *root;
-static node *proven;
-static unsigned int nodes;
+/*
+ * Delay table: a header followed by the delay of every number below the
+ * stop, starting with 0, as 16-bit integers in native byte order.  The
+ * header is written last, so an incomplete table is recognizable.
+ */
+struct table_header {
+	char		 magic[4];	/* "CLZT" */
+	uint32_t	 version;	/* doubles as a byte order check */
+	uint32_t	 entry_size;	/* bytes per entry */
+	uint32_t	 reserved;
+	uint64_t	 count;		/* number of entries */
+	uint64_t	 reserved2;
+};
+#define TABLE_MAGIC		"CLZT"
+#define TABLE_VERSION		1
+static const char *table_path;
+static int table_fd = -1;
 
 /*
- * Work queue
+ * Reachability queries: a number is in the tree bounded by the stop if
+ * its entire trajectory stays below the stop.  The answers for every
+ * number seen along the way are memoized in an open-addressing hash
+ * table, as n << 1 | reachable, which is flushed when it fills up.
  */
-#define WORKQUEUE_SIZE		(1<<20)
-#define WORKQUEUE_DEPTH		((qw + WORKQUEUE_SIZE - qr) % WORKQUEUE_SIZE)
-static uintmax_t queue[WORKQUEUE_SIZE];
-static unsigned int qr, qw;
+#define QUERY_MEMO_BITS		22
+#define QUERY_MEMO_SIZE		((size_t)1 << QUERY_MEMO_BITS)
+static const char *query_path;
+static uintmax_t *query_memo;
+static size_t query_memo_len;
+static uintmax_t nqueries, nreachable, query_steps, query_hits;
+static unsigned int query_flushes;
 
 /*
- * Statistics
+ * Performance counters per phase.  The insert phase is sampled once
+ * every PERF_SAMPLE_INTERVAL insertions and extrapolated; the traversal
+ * phase is what remains of the engine's run time once that estimate has
+ * been subtracted.
+ */
+enum phase {
+	PHASE_TRAVERSAL,
+	PHASE_INSERT,
+	PHASE_PROGRESS,
+	PHASE_OUTPUT,
+	PHASE_NPHASES
+};
+static const char *phase_name[PHASE_NPHASES] = {
+	"traversal", "insert", "progress", "output",
+};
+#define PERF_SAMPLE_INTERVAL	(1<<10)
+static perf_counters perf_main;
+static perf_values perf_phase[PHASE_NPHASES], perf_overhead;
+static uintmax_t perf_inserts, perf_sampled;
+
+/*
+ * Progress counters.  These are written only by the thread running the
+ * engine and sampled by the progress reporter, so relaxed loads and
+ * stores are sufficient and cost no more than plain ones.
  */
-static unsigned int maxnodes, maxdepth, maxrecurse;
+static struct {
+	atomic_uintmax_t visited;	/* numbers visited */
+	atomic_uintmax_t covered;	/* numbers recorded */
+	atomic_uintmax_t highest;	/* highest number recorded */
+	atomic_uintmax_t proven;	/* end of range starting at 1 */
+	atomic_uint	 nodes;		/* current node count */
+	atomic_uint	 maxdepth;	/* deepest node */
+	atomic_uint	 work;		/* queue depth or recursion depth */
+	atomic_uintmax_t enqueued;	/* numbers added to the work queue */
+	atomic_uintmax_t dequeued;	/* numbers taken off the work queue */
+	atomic_uint	 level;		/* current BFS level */
+} counters;
+
+#define COUNTER_LOAD(c) \
+	atomic_load_explicit(&counters.c, memory_order_relaxed)
+#define COUNTER_STORE(c, v) \
+	atomic_store_explicit(&counters.c, (v), memory_order_relaxed)
+#define COUNTER_INC(c) \
+	COUNTER_STORE(c, COUNTER_LOAD(c) + 1)
+
+/* progress interval in milliseconds */
+#define PROGRESS_INTERVAL	250
+
+/* time constant for the throughput average used for the ETA, in seconds */
+#define PROGRESS_ETA_TAU	5.0
+
+/*
+ * A snapshot of the progress counters, and rates derived from two of
+ * them.
+ */
+struct sample {
+	struct timespec	 time;
+	uintmax_t	 visited;
+	uintmax_t	 covered;
+	uintmax_t	 highest;
+	uintmax_t	 proven;
+	uintmax_t	 enqueued;
+	uintmax_t	 dequeued;
+	unsigned int	 nodes;
+	unsigned int	 maxdepth;
+	unsigned int	 work;
+	unsigned int	 level;
+	uintmax_t	 maxrss;
+};
 
-#define PROGRESS_INTERVAL	(1<<10)
+struct rates {
+	double		 visited;	/* numbers per second */
+	double		 inserted;	/* insertions per second */
+	double		 enqueued;	/* queue input per second */
+	double		 dequeued;	/* queue output per second */
+	double		 frontier;	/* growth of proven range per second */
+};
 
-static void fprintnodes(FILE *, const node *);
-static node *create(unsigned int, uintmax_t, uintmax_t);
-static void destroy(node *);
-static bool insert_into_leaf(node *, uintmax_t, uintmax_t);
-static bool insert_into_internal(node *, uintmax_t, uintmax_t);
-static bool insert(node *, uintmax_t, uintmax_t);
-static bool lookup(const node *, uintmax_t) __attribute__((__unused__));
-static bool work_append(uintmax_t);
+static pthread_t progress_thread;
+static pthread_mutex_t progress_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t progress_cv;
+static bool progress_done;
+
+static struct level *level_at(unsigned int);
+static void work_append(uintmax_t);
 static uintmax_t work_fetch(void);
+static bool insert_range(uintmax_t, uintmax_t);
+static void publish(void);
+static void publish_insert(void);
+static void sample(struct sample *);
+static double elapsed(const struct timespec *, const struct timespec *);
+static void rates(struct rates *, const struct sample *,
+    const struct sample *);
+static const char *humanize(char *, size_t, double);
+static bool treeless_proven(void);
+static uintmax_t expected_covered(void);
 static void progress(bool);
+static void *progress_main(void *);
+static void progress_start(void);
+static void progress_stop(void);
+static void fprintinsstats(FILE *);
+static void fprintlevels(FILE *);
+static void fprintperf(FILE *);
+static void report(FILE *);
+static uintmax_t available_memory(void);
+static uintmax_t projected_memory(void);
+static uintmax_t buffer_bytes(void);
+static void fprintmem(FILE *);
 static void collatz(void);
 static void collatz_r(uintmax_t);
+static void collatz_r_any(uintmax_t);
 static void collatz_i(void);
+static void collatz_replay(void);
+static void collatz_f(void);
+static const char *u128str(char *, size_t, unsigned __int128);
+static void record_append(struct record **, size_t *, size_t *,
+    uintmax_t, unsigned __int128);
+static void records_delay(struct chunk *);
+static void records_path(struct chunk *);
+static void records_merge(struct chunk *);
+static void *records_main(void *);
+static bool query_lookup(uintmax_t, bool *);
+static void query_remember(uintmax_t, bool);
+static bool query(uintmax_t);
+static void collatz_q(void);
+static void table_open(void);
+static void table_write(const struct chunk *);
+static void table_close(void);
+static void collatz_records(void);
 
 /*
- * Print out the tree.
+ * Get the statistics for a level, adding it if necessary.
  */
-static void
-fprintnodes(FILE *f, const node *n)
+static inline struct level *
+level_at(unsigned int l)
 {
 
-	if (n->left == NULL && n->right == NULL)
-		fprintf(f, "[%ju, %ju]\n", n->first, n->last);
-	if (n->left != NULL)
-		fprintnodes(f, n->left);
-	if (n->right != NULL)
-		fprintnodes(f, n->right);
+	if (l >= levels_size) {
+		levels_size = levels_size ? levels_size * 2 : 1024;
+		if (l >= levels_size)
+			levels_size = l + 1;
+		levels = realloc(levels, levels_size * sizeof *levels);
+		if (levels == NULL)
+			err(1, "realloc()");
+		memset(levels + nlevels, 0,
+		    (levels_size - nlevels) * sizeof *levels);
+	}
+	if (l >= nlevels)
+		nlevels = l + 1;
+	return (&levels[l]);
 }
 
 /*
- * Create a leaf node.
+ * Work queue for iterative version
  */
-static node *
-create(unsigned int depth, uintmax_t first, uintmax_t last)
+void
+work_append(uintmax_t num)
 {
-	node *n;
+	uintmax_t *nq;
 
-	debug("%6u creating [%ju, %ju]\n", depth, first, last);
-	if ((n = calloc(1, sizeof *n)) == NULL)
-		err(1, "calloc()");
-	n->covered = (n->last = last) - (n->first = first) + 1;
-	if ((n->depth = depth) > maxdepth)
-		maxdepth = depth;
-	nodes++;
-	if (++nodes > maxnodes)
-		maxnodes = nodes;
-	if (first == 1)
-		proven = n;
-	return (n);
+	if (qlen == qsize) {
+		/* full, double the size and unwrap */
+		qsize = qsize ? qsize * 2 : WORKQUEUE_SIZE;
+		if ((nq = realloc(queue, qsize * sizeof *queue)) == NULL)
+			err(1, "realloc()");
+		queue = nq;
+		if (qlen > 0 && qw <= qr) {
+			memcpy(queue + qlen, queue, qw * sizeof *queue);
+			qw += qlen;
+		}
+		debug("work queue grown to %zu\n", qsize);
+		trace_instant("queue grown");
+	}
+//	debug("append %12ju\n", num);
+	queue[qw] = num;
+	qw = (qw + 1) % qsize;
+	if (++qlen > maxqueue)
+		maxqueue = qlen;
+	COUNTER_INC(enqueued);
+}
+
+uintmax_t
+work_fetch(void)
+{
+	uintmax_t num;
+
+	if (qlen == 0)
+		return (0);
+	num = queue[qr];
+	qr = (qr + 1) % qsize;
+	qlen--;
+	COUNTER_INC(dequeued);
+//	debug("fetch %12ju\n", num);
+	return (num);
 }
 
 /*
- * Destroy a node.
+ * Insert a range into the tree on behalf of an engine, recording it in
+ * the insertion trace and sampling the performance counters if
+ * requested.
  */
-static void
-destroy(node *n)
+static inline bool
+insert_range(uintmax_t first, uintmax_t last)
+{
+	perf_values before, after;
+	bool found;
+
+	if (itw.f != NULL)
+		itrace_write(&itw, first, last);
+	if (!opt_e || perf_inserts++ % PERF_SAMPLE_INTERVAL != 0)
+		return (cover->insert(cset, first, last));
+	perf_read(&perf_main, &before);
+	found = cover->insert(cset, first, last);
+	perf_read(&perf_main, &after);
+	perf_accumulate(&perf_phase[PHASE_INSERT], &before, &after);
+	perf_sampled++;
+	return (found);
+}
+
+/* successful insertions between two updates of the published state */
+#define PUBLISH_INTERVAL	1024
+
+/*
+ * Publish the state of the tree for the progress reporter.
+ */
+static inline void
+publish(void)
 {
 
-	if (n == NULL)
+	if (TREELESS)
 		return;
-	destroy(n->left);
-	destroy(n->right);
-	debug("%6u destroying [%ju, %ju]\n", n->depth, n->first, n->last);
-	nodes--;
-	free(n);
+	COUNTER_STORE(covered, cover->covered(cset));
+	COUNTER_STORE(highest, cover->highest(cset));
+	COUNTER_STORE(proven, cover->proven(cset));
+	COUNTER_STORE(nodes, nodes);
+	COUNTER_STORE(maxdepth, maxdepth);
 }
 
 /*
- * Insert a range into a leaf node.
- *
- * Possible cases: the new range...
- * ...is a sub-range of this node
- * ...covers this node entirely
- * ...is left-adjacent to this node
- * ...is right-adjacent to this node
- * ...sits to the left of this node
- * ...sits to the right of this node
- *
- * Returns true if the entire range was already in the tree.
+ * Called by the engine after every successful insertion.  Querying the
+ * set costs three indirect calls, and the reporter only samples the
+ * counters every PROGRESS_INTERVAL milliseconds, so only publish every
+ * PUBLISH_INTERVAL insertions; progress_stop() publishes the final state.
  */
-static bool
-insert_into_leaf(node *n, uintmax_t first, uintmax_t last)
-{
-
-	assert(n->left == NULL && n->right == NULL);
-
-	/* cases where we remain a leaf */
-	if (first >= n->first && last <= n->last) {
-		/* sub-range */
-		return (true);
-	} else if (first <= n->last + 1 && last >= n->first - 1) {
-		/* overlaps with or adjacent to us */
-		debug("%6u expanding [%ju, %ju] to [%ju, %ju]\n",
-		    n->depth, n->first, n->last, first, last);
-		if (first < n->first)
-			n->first = first;
-		if (last > n->last)
-			n->last = last;
-		n->covered = n->last - n->first + 1;
-		if (n->first == 1)
-			proven = n;
-		return (false);
-	}
+static inline void
+publish_insert(void)
+{
+	static unsigned int pending;
 
-	/* cases where we split into child nodes */
-	if (last < n->first - 1) {
-		/* sits to the left */
-		debug("%6u splitting into [%ju, %ju] and [%ju, %ju]\n",
-		    n->depth, first, last, n->first, n->last);
-		n->left = create(n->depth + 1, first, last);
-		n->right = create(n->depth + 1, n->first, n->last);
-	} else if (first > n->last + 1) {
-		/* sits to the right */
-		debug("%6u splitting into [%ju, %ju] and [%ju, %ju]\n",
-		    n->depth, n->first, n->last, first, last);
-		n->left = create(n->depth + 1, n->first, n->last);
-		n->right = create(n->depth + 1, first, last);
-	} else {
-		assert(0);
-	}
-	n->first = n->left->first;
-	n->last = n->right->last;
-	n->covered = n->left->covered + n->right->covered;
-	return (false);
+	if (++pending < PUBLISH_INTERVAL)
+		return;
+	pending = 0;
+	publish();
 }
 
 /*
- * Insert a range into an internal node.
- *
- * Possible cases: the new range...
- * ...overlaps with or is adjacent to one of this node's children
- * ...overlaps with or is adjacent to both of this node's children
- * ...sits to the left of this node
- * ...sits to the right of this node
- * ...sits between this node's children
- *
- * Returns false if the number was already in the tree.
+ * Take a snapshot of the progress counters.
  */
-static bool
-insert_into_internal(node *n, uintmax_t first, uintmax_t last)
+static void
+sample(struct sample *smp)
 {
-	bool found;
+	struct rusage ru;
 
-	assert(n->left != NULL && n->right != NULL);
-
-	/* cases where we become a leaf */
-	if (first <= n->left->last + 1 && last >= n->right->first - 1) {
-		/* overlaps with or adjacent to both children */
-		if (first < n->first)
-			n->first = first;
-		if (last > n->last)
-			n->last = last;
-		debug("%6u coalescing [%ju, %ju] [%ju, %ju] into [%ju, %ju]\n",
-		    n->depth, n->left->first, n->left->last,
-		    n->right->first, n->right->last,
-		    n->first, n->last);
-		destroy(n->left);
-		destroy(n->right);
-		n->left = n->right = NULL;
-		n->covered = n->last - n->first + 1;
-		if (n->first == 1)
-			proven = n;
-		return (false);
-	}
+	getrusage(RUSAGE_SELF, &ru);
+	smp->maxrss = (uintmax_t)ru.ru_maxrss * 1024;
+	clock_gettime(CLOCK_MONOTONIC, &smp->time);
+	smp->visited = COUNTER_LOAD(visited);
+	smp->covered = COUNTER_LOAD(covered);
+	smp->highest = COUNTER_LOAD(highest);
+	smp->proven = COUNTER_LOAD(proven);
+	smp->enqueued = COUNTER_LOAD(enqueued);
+	smp->dequeued = COUNTER_LOAD(dequeued);
+	smp->nodes = COUNTER_LOAD(nodes);
+	smp->maxdepth = COUNTER_LOAD(maxdepth);
+	smp->work = opt_i ? smp->enqueued - smp->dequeued : COUNTER_LOAD(work);
+	smp->level = opt_i ? COUNTER_LOAD(level) : smp->work + 1;
+}
 
-	/* cases where we descend into our children */
-	if (first > n->left->last + 1 && last < n->right->first - 1) {
-		/* sits between them, pass it to the shallowest one */
-		if (n->left->depth < n->right->depth)
-			found = insert(n->left, first, last);
-		else
-			found = insert(n->right, first, last);
-	} else if (last < n->right->first - 1) {
-		/* overlaps with, adjacent to or left of left child */
-		found = insert(n->left, first, last);
-	} else if (first > n->left->last + 1) {
-		/* overlaps with, adjacent to or right of right child */
-		found = insert(n->right, first, last);
-	} else {
-		assert(0);
-	}
-	if (!found) {
-		n->first = n->left->first;
-		n->last = n->right->last;
-		n->covered = n->left->covered + n->right->covered;
-	}
-	return (found);
+/*
+ * Seconds elapsed between two points in time.
+ */
+static double
+elapsed(const struct timespec *from, const struct timespec *to)
+{
+
+	return ((to->tv_sec - from->tv_sec) +
+	    (to->tv_nsec - from->tv_nsec) / 1e9);
 }
 
 /*
- * Dispatch to correct insert function depending on leafiness.
+ * Compute rates of change between two snapshots.
  */
-static bool
-insert(node *n, uintmax_t first, uintmax_t last)
+static void
+rates(struct rates *r, const struct sample *from, const struct sample *to)
 {
-	bool found;
+	double dt;
 
-	assert(first <= last);
-	assert((n->left == NULL) == (n->right == NULL));
-	assert(n->left == NULL || n->first == n->left->first);
-	assert(n->right == NULL || n->last == n->right->last);
-	if ((first == last && (first == n->first || last == n->last)) ||
-	    (LEAF_NODE(n) && first == n->first && last == n->last)) {
-		/* trivial cases */
-		found = true;
-	} else {
-		/* do it the hard way */
-		debug("%6u inserting [%ju, %ju] into [%ju, %ju]\n",
-		    n->depth, first, last, n->first, n->last);
-		found = LEAF_NODE(n) ? insert_into_leaf(n, first, last) :
-		    insert_into_internal(n, first, last);
-	}
-	if (found) {
-		/* range was already covered */
-		debug("%6u found [%ju, %ju] in [%ju, %ju]\n",
-		    n->depth, first, last, n->first, n->last);
-	} else {
-		/* range was inserted, adjust coverage etc. */
-		if (LEAF_NODE(n)) {
-			n->covered = n->last - n->first + 1;
-		} else {
-			n->first = n->left->first;
-			n->last = n->right->last;
-			n->covered = n->left->covered + n->right->covered;
-		}
+	if ((dt = elapsed(&from->time, &to->time)) <= 0) {
+		memset(r, 0, sizeof *r);
+		return;
 	}
-	return (found);
+	r->visited = (to->visited - from->visited) / dt;
+	r->inserted = (to->covered - from->covered) / dt;
+	r->enqueued = (to->enqueued - from->enqueued) / dt;
+	r->dequeued = (to->dequeued - from->dequeued) / dt;
+	r->frontier = (to->proven - from->proven) / dt;
 }
 
 /*
- * Returns true if the specified number is contained in the tree.
+ * Format a number with an SI suffix.
  */
-static bool
-lookup(const node *n, uintmax_t num)
+static const char *
+humanize(char *buf, size_t size, double num)
 {
+	static const char suffix[] = " kMGTPE";
+	unsigned int i;
 
-	if (LEAF_NODE(n))
-		return (num >= n->first && num <= n->last);
-	else if (num >= n->left->first && num <= n->left->last)
-		return (lookup(n->left, num));
-	else if (num >= n->right->first && num <= n->right->last)
-		return (lookup(n->right, num));
-	else
-		return (false);
+	for (i = 0; num >= 999.95 && i < sizeof suffix - 2; ++i)
+		num /= 1000;
+	snprintf(buf, size, i > 0 ? "%.1f%c" : "%.0f", num, suffix[i]);
+	return (buf);
 }
 
 /*
- * Work queue for iterative version
+ * Whether an engine which does not keep a set of reached numbers has
+ * shown that everything below the stop reaches 1.  The forward pass
+ * has done so only if the map is 3n + 1 and it found neither a cycle
+ * other than the trivial one nor a divergent trajectory.  The delay
+ * and path record searches only run for 3n + 1 and follow every
+ * trajectory.  Queries only look at the numbers they are asked about.
  */
-bool
-work_append(uintmax_t num)
+static bool
+treeless_proven(void)
 {
 
-	if (qw == qr && queue[qw] != 0)
+	if (query_path != NULL)
 		return (false);
-//	debug("append %12ju\n", num);
-	queue[qw] = num;
-	qw = (qw + 1) % WORKQUEUE_SIZE;
+	if (opt_f)
+		return (map_classic(&cmap) && fwd.divergent == 0 &&
+		    (fwd.ncycles == 0 ||
+		    (fwd.ncycles == 1 && fwd.cycle[0] == 1)));
 	return (true);
 }
 
-uintmax_t
-work_fetch(void)
+/*
+ * The number of numbers below the stop we expect to have recorded when
+ * the engine finishes, or 0 if we cannot tell.  Forward verification
+ * and the record searches work through every one of them.  The reverse
+ * engines only reach some of them: for 3n+1, between 39.5% and 39.9%
+ * from 2^18 to 2^26.  We have no such figure for other maps, for
+ * replays or for queries.
+ */
+#define EXPECTED_COVERED(stop)	((stop) / 1000 * 396)
+
+static uintmax_t
+expected_covered(void)
 {
-	uintmax_t num;
 
-	if (qr == qw && queue[qr] == 0)
+	if (opt_f || opt_D || opt_P)
+		return (stop - 1);
+	if (TREELESS || replay != NULL || !map_classic(&cmap))
 		return (0);
-	num = queue[qr];
-	queue[qr] = 0;
-	qr = (qr + 1) % WORKQUEUE_SIZE;
-//	debug("fetch %12ju\n", num);
-	return (num);
+	return (EXPECTED_COVERED(stop));
 }
 
 /*
- * Show the lowest and highest numbers recorded and the percentage of
- * numbers within that range that have also been recorded.
+ * Show the lowest and highest numbers recorded, the percentage of
+ * numbers within that range that have also been recorded, and the
+ * current throughput.  The ETA is based on an exponentially weighted
+ * average of the insertion rate and the number of numbers we expect to
+ * have recorded by the end; see expected_covered().
+ *
+ * Each call also appends a record to the time-series file, if there
+ * is one.  The final call prints averages over the entire run rather
+ * than over the last interval.
  */
-static inline void
+static void
 progress(bool final)
 {
-	static unsigned int count;
-	static char buf[72];
+	static struct sample first, last;
+	static double avg;
+	static int width;
+	struct sample cur;
+	struct rates r;
+	char buf[160], vr[16], ir[16], er[16], dr[16], fr[16], eta[16];
+	uintmax_t total, left, pct;
+	double alpha, dt, secs;
+	int len;
 
-	if (tty && (final || count-- == 0)) {
-		snprintf(buf, sizeof buf,
-		    "%3ju%% [1, %ju] (n %9u d %9u %c %9u)%*s",
-		    (root->covered * 100 / (root->last - root->first + 1)),
-		    proven->last, nodes, maxdepth, opt_i ? 'q' : 'r',
-		    opt_i ? WORKQUEUE_DEPTH : maxrecurse, 72, " ");
-		buf[70] = final ? '\n' : '\r';
-		write(STDERR_FILENO, buf, sizeof buf - 1);
-		count = PROGRESS_INTERVAL;
+	sample(&cur);
+	trace_counter("covered", cur.covered);
+	trace_counter("nodes", cur.nodes);
+	trace_counter(opt_i ? "queue" : "recursion", cur.work);
+	if (first.time.tv_sec == 0 && first.time.tv_nsec == 0) {
+		/* first call, nothing to compare against */
+		first = last = cur;
+		avg = 0;
+		return;
+	}
+	rates(&r, &last, &cur);
+	dt = elapsed(&last.time, &cur.time);
+	alpha = dt / (dt + PROGRESS_ETA_TAU);
+	avg = avg == 0 ? r.inserted : avg + alpha * (r.inserted - avg);
+	total = expected_covered();
+	left = total > cur.covered ? total - cur.covered : 0;
+	secs = avg > 0 && total > 0 ? left / avg : -1;
+	if (tsf != NULL) {
+		fprintf(tsf, "%.3f,%ju,%ju,%ju,%ju,%u,%u,%u,%ju,%ju,%ju,"
+		    "%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%u\n",
+		    elapsed(&first.time, &cur.time),
+		    cur.visited, cur.covered, cur.highest, cur.proven,
+		    cur.nodes, cur.maxdepth, cur.work,
+		    cur.enqueued, cur.dequeued, cur.maxrss,
+		    r.visited, r.inserted, r.enqueued, r.dequeued,
+		    r.frontier, secs, cur.level);
+		fflush(tsf);
+	}
+	last = cur;
+	if (!tty)
+		return;
+	if (final) {
+		rates(&r, &first, &cur);
+		secs = elapsed(&first.time, &cur.time);
 	}
+	/* density of the tree, or how far along forward verification is */
+	pct = query_path != NULL ?
+	    (cur.visited ? cur.covered * 100 / cur.visited : 0) :
+	    TREELESS ? cur.proven * 100 / stop : cur.covered * 100 / cur.highest;
+	if (secs < 0)
+		snprintf(eta, sizeof eta, "--:--:--");
+	else
+		snprintf(eta, sizeof eta, "%02u:%02u:%02u",
+		    (unsigned int)(secs / 3600),
+		    (unsigned int)(secs / 60) % 60,
+		    (unsigned int)secs % 60);
+	len = snprintf(buf, sizeof buf,
+	    "%3ju%% [1, %ju] (n %u d %u %c %u) %s/s +%s/s f %s/s",
+	    pct, cur.proven,
+	    cur.nodes, cur.maxdepth, opt_i ? 'q' : 'r', cur.work,
+	    humanize(vr, sizeof vr, r.visited),
+	    humanize(ir, sizeof ir, r.inserted),
+	    humanize(fr, sizeof fr, r.frontier));
+	if (opt_i && len > 0 && (size_t)len < sizeof buf)
+		len += snprintf(buf + len, sizeof buf - len,
+		    " q %s/%s", humanize(er, sizeof er, r.enqueued),
+		    humanize(dr, sizeof dr, r.dequeued));
+	if (len > 0 && (size_t)len < sizeof buf)
+		len += snprintf(buf + len, sizeof buf - len,
+		    " %s %s", final ? "in" : "eta", eta);
+	if (len < 0 || (size_t)len > sizeof buf - 2)
+		len = sizeof buf - 2;
+	/* pad with spaces to erase whatever was left of the previous line */
+	while (len < width && (size_t)len < sizeof buf - 2)
+		buf[len++] = ' ';
+	width = len;
+	buf[len++] = final ? '\n' : '\r';
+	(void)write(STDERR_FILENO, buf, len);
+}
+
+/*
+ * Progress reporter thread: sample the counters every PROGRESS_INTERVAL
+ * milliseconds until told to stop.
+ */
+static void *
+progress_main(void *arg __attribute__((__unused__)))
+{
+	perf_counters pc;
+	perf_values before, after;
+	struct timespec ts;
+
+	trace_thread("progress");
+	if (opt_e)
+		(void)perf_open(&pc);
+	pthread_mutex_lock(&progress_mtx);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	while (!progress_done) {
+		ts.tv_nsec += PROGRESS_INTERVAL * 1000000L;
+		while (ts.tv_nsec >= 1000000000) {
+			ts.tv_nsec -= 1000000000;
+			ts.tv_sec++;
+		}
+		if (pthread_cond_timedwait(&progress_cv, &progress_mtx,
+		    &ts) != ETIMEDOUT || progress_done)
+			continue;
+		trace_begin("progress");
+		if (opt_e)
+			perf_read(&pc, &before);
+		progress(false);
+		trace_end("progress");
+		if (opt_e) {
+			perf_read(&pc, &after);
+			perf_accumulate(&perf_phase[PHASE_PROGRESS],
+			    &before, &after);
+		}
+	}
+	pthread_mutex_unlock(&progress_mtx);
+	if (opt_e)
+		perf_close(&pc);
+	return (NULL);
+}
+
+/*
+ * Start the progress reporter, if stderr is a terminal or we were asked
+ * to record a time series.
+ */
+static void
+progress_start(void)
+{
+	pthread_condattr_t attr;
+
+	publish();
+	if (!tty && tsf == NULL)
+		return;
+	progress(false);
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&progress_cv, &attr);
+	pthread_condattr_destroy(&attr);
+	if ((errno = pthread_create(&progress_thread, NULL,
+	    progress_main, NULL)) != 0)
+		err(1, "pthread_create()");
+}
+
+/*
+ * Stop the progress reporter and print the final tally.
+ */
+static void
+progress_stop(void)
+{
+
+	publish();
+	if (!tty && tsf == NULL)
+		return;
+	pthread_mutex_lock(&progress_mtx);
+	progress_done = true;
+	pthread_cond_signal(&progress_cv);
+	pthread_mutex_unlock(&progress_mtx);
+	pthread_join(progress_thread, NULL);
+	progress(true);
 }
 
 /*
@@ -417,80 +790,1040 @@ progress(bool final)
  *
  * Note: if N - 1 ≡ 0 mod 6, then (N - 1) / 3 ≡ 0 mod 6, which means it's
  * even, which means we wouldn't have gotten from there to N.
+ *
+ * For a generalized map qn + r, the second rule becomes: if N - r ≡ q
+ * mod 2q, N = (N - r) / q.  An odd predecessor of 1, 2 or 4 would be
+ * less than 4 / q, i.e. 1 at most, which is already recorded (it is the
+ * odd predecessor of 4 under 3n + 1), so the initialization is the same:
+ * everything else is reached by working back from 4.
  */
 static void
 collatz(void)
 {
 	struct timespec start, end;
+	perf_values before, after;
+	uintmax_t first, last, projected, available;
+	double scale;
+	char buf[40];
+	int i, ret;
 
-	clock_gettime(CLOCK_REALTIME, &start);
-	verbose("stop at %ju\n", stop);
-	root = create(0, 1, 2);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (TREELESS) {
+		if (opt_f)
+			verbose("stop at %ju, map %un+%u, %s kernel\n", stop,
+			    cmap.q, cmap.r, KERNEL_NAME);
+		else if (query_path != NULL)
+			verbose("stop at %ju, queries from %s\n", stop,
+			    query_path);
+		else
+			verbose("stop at %ju, %u threads\n", stop, nthreads);
+		progress_start();
+		trace_begin("engine");
+		if (opt_e)
+			perf_read(&perf_main, &before);
+		if (opt_f)
+			collatz_f();
+		else if (query_path != NULL)
+			collatz_q();
+		else
+			collatz_records();
+		if (opt_e) {
+			perf_read(&perf_main, &after);
+			perf_accumulate(&perf_phase[PHASE_TRAVERSAL],
+			    &before, &after);
+		}
+		trace_end("engine");
+		progress_stop();
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		wall = elapsed(&start, &end);
+		verbose("done in %.3f s\n", wall);
+		if (opt_f) {
+			verbose("iterated %ju of %ju numbers in %ju steps, "
+			    "longest glide %ju steps from %ju\n", fwd.iterated,
+			    fwd.numbers, fwd.steps, fwd.maxsteps,
+			    fwd.maxsteps_n);
+			for (i = 0; i < (int)fwd.ncycles; ++i)
+				verbose("cycle with minimum %s\n", u128str(buf,
+				    sizeof buf, fwd.cycle[i]));
+			if (fwd.divergent > 0)
+				verbose("%ju trajectories diverge, the first "
+				    "from %ju\n", fwd.divergent, fwd.divergent_n);
+			/* everything reaches 1 unless there are other cycles */
+			if (opt_v && fwd.divergent == 0 && (fwd.ncycles == 0 ||
+			    (fwd.ncycles == 1 && fwd.cycle[0] == 1)))
+				printf("[1, %ju]\n", stop - 1);
+		} else if (query_path != NULL) {
+			verbose("%ju of %ju reachable, %ju steps, "
+			    "%ju memo hits, %.0f queries/s\n", nreachable,
+			    nqueries, query_steps, query_hits,
+			    wall > 0 ? nqueries / wall : 0);
+		} else {
+			verbose("%zu records\n", nrecords);
+		}
+		if (opt_e)
+			fprintperf(stderr);
+		return;
+	}
+	if (replay != NULL) {
+		/* the first record is the initial state of the tree */
+		if ((ret = itrace_read(&itr, &first, &last)) < 0)
+			errx(1, "%s: invalid or truncated record at offset "
+			    "%zu", replay, itr.offset);
+		if (ret == 0)
+			errx(1, "%s: empty trace", replay);
+		verbose("replaying %s\n", replay);
+	} else {
+		first = 1;
+		last = 2;
+		verbose("stop at %ju, map %un+%u\n", stop, cmap.q, cmap.r);
+	}
+	cset = cover->init(first, last, opt_F ? COVER_NOFINGER : 0);
+	if (itw.f != NULL)
+		itrace_write(&itw, first, last);
+	if (replay == NULL) {
+		/* 1 and 2 are levels 0 and 1 */
+		level_at(0)->numbers = level_at(1)->numbers = 1;
+		level_at(0)->intervals = level_at(1)->intervals = 1;
+	}
+	if (replay == NULL) {
+		projected = projected_memory();
+		available = available_memory();
+		verbose("projected memory use %.1f MiB\n",
+		    projected / 1048576.0);
+		if (available > 0 && projected > available)
+			warnx("projected memory use %.1f MiB exceeds "
+			    "available memory %.1f MiB", projected / 1048576.0,
+			    available / 1048576.0);
+	}
 	debug("           ---\n");
-	if (opt_i) {
-		(void)work_append(4);
+	progress_start();
+	if (opt_e)
+		perf_read(&perf_main, &before);
+	trace_begin("engine");
+	if (replay != NULL) {
+		collatz_replay();
+	} else if (opt_i) {
+		work_append(4);
 		collatz_i();
-	} else {
+	} else if (map_classic(&cmap)) {
 		collatz_r(4);
+	} else {
+		collatz_r_any(4);
 	}
-	progress(true);
-	clock_gettime(CLOCK_REALTIME, &end);
-	end.tv_sec -= start.tv_sec;
-	if ((end.tv_nsec -= start.tv_nsec) < 0)
-		end.tv_nsec += 1000000000;
-	verbose("done in %lu.%.03lu s\n",
-	    (unsigned long)end.tv_sec,
-	    (unsigned long)end.tv_nsec / 1000000);
+	if (cover->flush != NULL) {
+		/* let the backend catch up */
+		cover->flush(cset);
+		publish();
+	}
+	trace_end("engine");
+	if (opt_e) {
+		perf_read(&perf_main, &after);
+		perf_accumulate(&perf_phase[PHASE_TRAVERSAL], &before, &after);
+		/*
+		 * Correct the insert samples for the cost of reading the
+		 * counters, then extrapolate and subtract.
+		 */
+		scale = perf_sampled ? (double)perf_inserts / perf_sampled : 0;
+		for (i = 0; i < PERF_NEVENTS; ++i) {
+			if (perf_phase[PHASE_INSERT].value[i] >
+			    perf_overhead.value[i] * perf_sampled)
+				perf_phase[PHASE_INSERT].value[i] -=
+				    perf_overhead.value[i] * perf_sampled;
+			else
+				perf_phase[PHASE_INSERT].value[i] = 0;
+			perf_phase[PHASE_INSERT].value[i] *= scale;
+			if (perf_phase[PHASE_INSERT].value[i] >
+			    perf_phase[PHASE_TRAVERSAL].value[i])
+				perf_phase[PHASE_INSERT].value[i] =
+				    perf_phase[PHASE_TRAVERSAL].value[i];
+			perf_phase[PHASE_TRAVERSAL].value[i] -=
+			    perf_phase[PHASE_INSERT].value[i];
+		}
+	}
+	progress_stop();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	wall = elapsed(&start, &end);
+	verbose("done in %.3f s\n", wall);
+	if (opt_d || opt_v)
+		fprintinsstats(stderr);
+	if (opt_d || opt_v)
+		fprintlevels(stderr);
+	if (opt_d || opt_v)
+		fprintmem(stderr);
+	if (opt_e)
+		perf_read(&perf_main, &before);
+	trace_begin("output");
 	if (opt_v)
-		fprintnodes(stdout, root);
+		cover->fprint(stdout, cset);
+	fflush(stdout);
+	trace_end("output");
+	if (opt_e) {
+		perf_read(&perf_main, &after);
+		perf_accumulate(&perf_phase[PHASE_OUTPUT], &before, &after);
+		fprintperf(stderr);
+	}
 }
 
-static void
-collatz_i(void)
+/*
+ * The engines are written for an arbitrary map, and instantiated once
+ * for 3n + 1, which the compiler specializes, and once for whatever map
+ * was requested.
+ */
+static inline __attribute__((__always_inline__)) void
+collatz_i_map(unsigned int q, unsigned int r)
 {
-	uintmax_t num;
+	unsigned int level;
+	uintmax_t num, pred;
+	size_t left;
 
-	while ((num = work_fetch()) != 0) {
-		progress(false);
-		if (num >= stop)
+	/* the queue holds the first level we are about to process */
+	COUNTER_STORE(level, 2);
+	for (level = 2, left = qlen; (num = work_fetch()) != 0; left--) {
+		if (left == 0) {
+			/* everything left in the queue is one level down */
+			if (LEVEL_INTERVALS)
+				level_at(level)->intervals =
+				    cover->intervals(cset);
+			COUNTER_STORE(level, ++level);
+			left = qlen + 1;
+		}
+		COUNTER_INC(visited);
+		if (num >= stop) {
+			level_at(level)->beyond++;
+			nbeyond++;
 			continue;
-		if (insert(root, num, num))
+		}
+		if (insert_range(num, num)) {
+			nfound++;
 			continue;
+		}
+		level_at(level)->numbers++;
+		publish_insert();
 		work_append(num * 2);
-		if (--num % 6 == 3) {
-			work_append(num / 3);
+		if (map_pred(num, q, r, &pred)) {
+			work_append(pred);
 			debug("           ---\n");
 		}
 		debug("           ---\n");
 	}
+	if (LEVEL_INTERVALS)
+		level_at(level)->intervals = cover->intervals(cset);
 }
 
 static void
-collatz_r(uintmax_t num)
+collatz_i(void)
 {
-	static uintmax_t depth;
+
+	if (map_classic(&cmap))
+		collatz_i_map(3, 1);
+	else
+		collatz_i_map(cmap.q, cmap.r);
+}
+
+/* recursion depth, and the address of the outermost frame */
+static uintmax_t rdepth;
+static uintptr_t rframe;
+
+static inline __attribute__((__always_inline__)) void
+collatz_r_map(uintmax_t num, unsigned int q, unsigned int r,
+    void (*self)(uintmax_t))
+{
+	uintmax_t pred;
 	bool found;
 
-	if (++depth > maxrecurse)
-		maxrecurse = depth;
-	progress(false);
-	if (num >= stop)
-		return;
-	found = insert(root, num, num);
-	debug("           ---\n");
-	if (found)
+	if (++rdepth > maxrecurse) {
+		/* measure our stack frame while we're at it */
+		if (rdepth == 1)
+			rframe = (uintptr_t)__builtin_frame_address(0);
+		else if (rdepth == 2)
+			frame_bytes = rframe - (uintptr_t)__builtin_frame_address(0);
+		maxrecurse = rdepth;
+	}
+	COUNTER_INC(visited);
+	COUNTER_STORE(work, rdepth);
+	if (num < stop) {
+		found = insert_range(num, num);
+		debug("           ---\n");
+		if (!found) {
+			level_at(rdepth + 1)->numbers++;
+			publish_insert();
+			self(num * 2);
+			if (map_pred(num, q, r, &pred))
+				self(pred);
+		} else {
+			nfound++;
+		}
+	} else {
+		level_at(rdepth + 1)->beyond++;
+		nbeyond++;
+	}
+	--rdepth;
+}
+
+static void
+collatz_r(uintmax_t num)
+{
+
+	collatz_r_map(num, 3, 1, collatz_r);
+}
+
+static void
+collatz_r_any(uintmax_t num)
+{
+
+	collatz_r_map(num, cmap.q, cmap.r, collatz_r_any);
+}
+
+/*
+ * Verify every number below the stop by iterating forward until its
+ * trajectory drops below it.  The kernel is fed one chunk at a time so
+ * the progress counters stay reasonably fresh.  The frontier only
+ * advances for as long as treeless_proven() holds.
+ */
+static void
+collatz_f(void)
+{
+	uintmax_t first, last;
+
+	for (first = 1; first < stop; first = last + 1) {
+		last = MIN(first + FORWARD_CHUNK - 1, stop - 1);
+		if (map_classic(&cmap))
+			kernel->func(first, last, &fwd);
+		else
+			fwd_map(first, last, cmap.q, cmap.r, &fwd);
+		COUNTER_STORE(visited, fwd.iterated);
+		COUNTER_STORE(covered, last);
+		COUNTER_STORE(highest, last);
+		if (treeless_proven())
+			COUNTER_STORE(proven, last);
+	}
+}
+
+/*
+ * Format a 128-bit number in decimal.
+ */
+static const char *
+u128str(char *buf, size_t size, unsigned __int128 num)
+{
+	char tmp[40], *p;
+
+	p = tmp + sizeof tmp;
+	*--p = '\0';
+	do {
+		*--p = '0' + (char)(num % 10);
+		num /= 10;
+	} while (num > 0);
+	snprintf(buf, size, "%s", p);
+	return (buf);
+}
+
+/*
+ * Add a record to a list.
+ */
+static void
+record_append(struct record **recs, size_t *nrecs, size_t *size,
+    uintmax_t n, unsigned __int128 value)
+{
+
+	if (*nrecs == *size) {
+		*size = *size ? *size * 2 : 16;
+		if ((*recs = realloc(*recs, *size * sizeof **recs)) == NULL)
+			err(1, "realloc()");
+	}
+	(*recs)[*nrecs].n = n;
+	(*recs)[*nrecs].value = value;
+	++*nrecs;
+}
+
+/*
+ * Collect the delay records within a chunk.
+ */
+static void
+records_delay(struct chunk *c)
+{
+	unsigned int best, d;
+	uintmax_t n;
+
+	c->nrecs = 0;
+	for (best = 0, n = c->first; n <= c->last; ++n) {
+		d = delay(n);
+		if (c->delays != NULL)
+			c->delays[n - c->first] = d;
+		if (d > best || c->nrecs == 0)
+			record_append(&c->recs, &c->nrecs, &c->size,
+			    n, best = d);
+	}
+}
+
+/*
+ * Collect the path records within a chunk.  Apart from 1 and 2, these
+ * can only be numbers congruent to 3 mod 4: a number congruent to 1 mod
+ * 4 peaks at 3n + 1, below the peak of n - 2, while an even number peaks
+ * either at itself, below the peak of n - 1, or at the peak of its half.
+ */
+static void
+records_path(struct chunk *c)
+{
+	unsigned __int128 best, peak;
+	uintmax_t n;
+
+	c->nrecs = 0;
+	for (best = 0, n = c->first; n <= c->last && n < 3; ++n)
+		record_append(&c->recs, &c->nrecs, &c->size, n, best = n);
+	for (n += (3 - n) & 3; n <= c->last; n += 4)
+		if ((peak = fwd_peak(n)) > best || c->nrecs == 0)
+			record_append(&c->recs, &c->nrecs, &c->size,
+			    n, best = peak);
+}
+
+/*
+ * Merge a completed chunk into the global list of records, and print
+ * the new ones.  Called with the records mutex held, in chunk order.
+ */
+static void
+records_merge(struct chunk *c)
+{
+	struct record *rec;
+	char buf[40];
+	size_t i;
+
+	for (i = 0; i < c->nrecs; ++i) {
+		rec = &c->recs[i];
+		if (nrecords > 0 && rec->value <= records[nrecords - 1].value)
+			continue;
+		record_append(&records, &nrecords, &records_size,
+		    rec->n, rec->value);
+		printf("%ju %s\n", rec->n, u128str(buf, sizeof buf, rec->value));
+	}
+	COUNTER_STORE(visited, COUNTER_LOAD(visited) + c->last - c->first + 1);
+	COUNTER_STORE(covered, c->last);
+	COUNTER_STORE(highest, c->last);
+	COUNTER_STORE(proven, c->last);
+}
+
+/*
+ * Record search worker: claim a chunk, scan it, and merge whatever
+ * chunks are ready, until there are none left.
+ */
+static void *
+records_main(void *arg)
+{
+	struct chunk *c;
+	uintmax_t i;
+
+	if (arg != NULL)
+		trace_thread(arg);
+	pthread_mutex_lock(&records_mtx);
+	for (;;) {
+		while (nextchunk < nchunks && nextchunk >= merged + nslots)
+			pthread_cond_wait(&records_cv, &records_mtx);
+		if ((i = nextchunk) >= nchunks)
+			break;
+		nextchunk++;
+		pthread_mutex_unlock(&records_mtx);
+		c = &window[i % nslots];
+		c->first = MAX(i * RECORD_CHUNK, 1);
+		c->last = MIN((i + 1) * RECORD_CHUNK - 1, stop - 1);
+		trace_begin("chunk");
+		record_scan(c);
+		trace_end("chunk");
+		if (table_fd >= 0)
+			table_write(c);
+		pthread_mutex_lock(&records_mtx);
+		c->done = true;
+		trace_begin("merge");
+		while (merged < nchunks && window[merged % nslots].done) {
+			records_merge(&window[merged % nslots]);
+			window[merged % nslots].done = false;
+			merged++;
+		}
+		trace_end("merge");
+		pthread_cond_broadcast(&records_cv);
+	}
+	pthread_mutex_unlock(&records_mtx);
+	return (NULL);
+}
+
+/*
+ * Search for records using nthreads threads, one of which is us.
+ */
+static void
+collatz_records(void)
+{
+	pthread_t *threads;
+	char (*names)[24];
+	unsigned int i;
+
+	if (opt_D) {
+		trace_begin("cache");
+		if (delay_init(cache_bits, cache_path) != 0)
+			err(1, "%s", cache_path);
+		trace_end("cache");
+		verbose("delay cache for n < 2^%u, %.1f MiB\n", delay_bits,
+		    delay_cache_bytes() / 1048576.0);
+		record_scan = records_delay;
+	} else {
+		record_scan = records_path;
+	}
+	nchunks = (stop - 1) / RECORD_CHUNK + 1;
+	nslots = nthreads * RECORD_WINDOW;
+	if ((window = calloc(nslots, sizeof *window)) == NULL ||
+	    (threads = calloc(nthreads, sizeof *threads)) == NULL ||
+	    (names = calloc(nthreads, sizeof *names)) == NULL)
+		err(1, "calloc()");
+	if (table_fd >= 0) {
+		for (i = 0; i < nslots; ++i)
+			if ((window[i].delays = calloc(RECORD_CHUNK,
+			    sizeof *window[i].delays)) == NULL)
+				err(1, "calloc()");
+	}
+	for (i = 1; i < nthreads; ++i) {
+		snprintf(names[i], sizeof names[i], "worker %u", i);
+		if ((errno = pthread_create(&threads[i], NULL,
+		    records_main, names[i])) != 0)
+			err(1, "pthread_create()");
+	}
+	records_main(NULL);
+	for (i = 1; i < nthreads; ++i)
+		pthread_join(threads[i], NULL);
+	fflush(stdout);
+	for (i = 0; i < nslots; ++i) {
+		free(window[i].recs);
+		free(window[i].delays);
+	}
+	free(window);
+	free(threads);
+	free(names);
+}
+
+/*
+ * Look a number up in the memo.
+ */
+static inline bool
+query_lookup(uintmax_t n, bool *reachable)
+{
+	size_t i;
+
+	for (i = (n * 0x9e3779b97f4a7c15ULL) >> (64 - QUERY_MEMO_BITS);
+	     query_memo[i] != 0; i = (i + 1) % QUERY_MEMO_SIZE) {
+		if (query_memo[i] >> 1 == n) {
+			*reachable = query_memo[i] & 1;
+			return (true);
+		}
+	}
+	return (false);
+}
+
+/*
+ * Remember the answer for a number, flushing the memo first if it is
+ * three quarters full.
+ */
+static inline void
+query_remember(uintmax_t n, bool reachable)
+{
+	size_t i;
+
+	if (query_memo_len >= QUERY_MEMO_SIZE / 4 * 3) {
+		memset(query_memo, 0, QUERY_MEMO_SIZE * sizeof *query_memo);
+		query_memo_len = 0;
+		query_flushes++;
+		trace_instant("memo flushed");
+	}
+	for (i = (n * 0x9e3779b97f4a7c15ULL) >> (64 - QUERY_MEMO_BITS);
+	     query_memo[i] != 0; i = (i + 1) % QUERY_MEMO_SIZE)
+		if (query_memo[i] >> 1 == n)
+			return;
+	query_memo[i] = n << 1 | reachable;
+	query_memo_len++;
+}
+
+/*
+ * Follow the trajectory of n until it reaches 1, reaches a number whose
+ * answer we already know, or leaves the tree, then record the answer
+ * for every number along the way.
+ */
+static bool
+query(uintmax_t n)
+{
+	static uintmax_t *path;
+	static size_t size;
+	size_t len, i;
+	uintmax_t x;
+	bool reachable;
+
+	for (len = 0, x = n; ; ) {
+		if (x >= stop) {
+			reachable = false;
+			break;
+		}
+		if (x == 1) {
+			reachable = true;
+			break;
+		}
+		if (query_lookup(x, &reachable)) {
+			query_hits++;
+			break;
+		}
+		if (len == size) {
+			size = size ? size * 2 : 1024;
+			if ((path = realloc(path, size * sizeof *path)) == NULL)
+				err(1, "realloc()");
+		}
+		path[len++] = x;
+		/* 3x + 1 must not exceed the stop, nor overflow */
+		x = x % 2 ? (x > (stop - 2) / 3 ? stop : 3 * x + 1) : x / 2;
+	}
+	query_steps += len;
+	for (i = 0; i < len; ++i)
+		query_remember(path[i], reachable);
+	return (reachable);
+}
+
+/*
+ * Answer reachability queries, one number per line.
+ */
+static void
+collatz_q(void)
+{
+	char line[128], *e;
+	uintmax_t n;
+	unsigned int lno;
+	bool reachable;
+	FILE *f;
+
+	if (strcmp(query_path, "-") == 0)
+		f = stdin;
+	else if ((f = fopen(query_path, "r")) == NULL)
+		err(1, "%s", query_path);
+	if ((query_memo = calloc(QUERY_MEMO_SIZE, sizeof *query_memo)) == NULL)
+		err(1, "calloc()");
+	for (lno = 1; fgets(line, sizeof line, f) != NULL; ++lno) {
+		errno = 0;
+		n = strtoumax(line, &e, 10);
+		if (e == line || (*e != '\n' && *e != '\0') || errno != 0 ||
+		    n == 0) {
+			warnx("%s:%u: invalid number", query_path, lno);
+			continue;
+		}
+		reachable = query(n);
+		printf("%ju %s\n", n, reachable ? "reachable" : "unreachable");
+		nqueries++;
+		nreachable += reachable;
+		COUNTER_STORE(visited, nqueries);
+		COUNTER_STORE(covered, nreachable);
+	}
+	if (ferror(f))
+		err(1, "%s", query_path);
+	if (f != stdin)
+		fclose(f);
+	fflush(stdout);
+}
+
+/*
+ * Create the delay table and size it for the whole range, so workers can
+ * write their chunks wherever they belong as soon as they are done.
+ */
+static void
+table_open(void)
+{
+
+	if ((table_fd = open(table_path, O_RDWR | O_CREAT | O_TRUNC,
+	    0644)) < 0)
+		err(1, "%s", table_path);
+	if (ftruncate(table_fd, sizeof(struct table_header) +
+	    stop * sizeof(uint16_t)) != 0)
+		err(1, "%s", table_path);
+}
+
+/*
+ * Write a chunk's worth of delays to the table.
+ */
+static void
+table_write(const struct chunk *c)
+{
+	size_t len;
+	off_t off;
+
+	trace_begin("table");
+	len = (c->last - c->first + 1) * sizeof *c->delays;
+	off = sizeof(struct table_header) + c->first * sizeof *c->delays;
+	if (pwrite(table_fd, c->delays, len, off) != (ssize_t)len)
+		err(1, "%s", table_path);
+	trace_end("table");
+}
+
+/*
+ * Write the header and close the table.
+ */
+static void
+table_close(void)
+{
+	struct table_header hdr;
+
+	memset(&hdr, 0, sizeof hdr);
+	memcpy(hdr.magic, TABLE_MAGIC, sizeof hdr.magic);
+	hdr.version = TABLE_VERSION;
+	hdr.entry_size = sizeof(uint16_t);
+	hdr.count = stop;
+	if (pwrite(table_fd, &hdr, sizeof hdr, 0) != (ssize_t)sizeof hdr ||
+	    close(table_fd) != 0)
+		err(1, "%s", table_path);
+	table_fd = -1;
+}
+
+/*
+ * Estimate the amount of memory available to us: the kernel's estimate
+ * if there is one, otherwise the amount of free physical memory, or 0
+ * if we have no idea.
+ */
+static uintmax_t
+available_memory(void)
+{
+	char line[128];
+	uintmax_t kb;
+	FILE *f;
+
+	if ((f = fopen("/proc/meminfo", "r")) != NULL) {
+		while (fgets(line, sizeof line, f) != NULL) {
+			if (sscanf(line, "MemAvailable: %ju kB", &kb) == 1) {
+				fclose(f);
+				return (kb * 1024);
+			}
+		}
+		fclose(f);
+	}
+#ifdef _SC_AVPHYS_PAGES
+	return ((uintmax_t)sysconf(_SC_AVPHYS_PAGES) * sysconf(_SC_PAGESIZE));
+#else
+	return (0);
+#endif
+}
+
+/*
+ * Project the peak memory use of a run to the chosen stop.
+ */
+static uintmax_t
+projected_memory(void)
+{
+	uintmax_t bytes, qlen;
+
+	if (TREELESS)
+		return (0);
+	bytes = cover->projected(stop);
+	if (opt_i) {
+		/* the queue doubles in size when full */
+		for (qlen = WORKQUEUE_SIZE; qlen < PROJECTED_QUEUE(stop); )
+			qlen *= 2;
+		bytes += qlen * sizeof *queue;
+	}
+	return (bytes);
+}
+
+/*
+ * Memory used for buffers other than the work queue.
+ */
+static uintmax_t
+buffer_bytes(void)
+{
+	uintmax_t bytes;
+
+	bytes = trace_enabled ? trace_bytes() : 0;
+	if (itw.f != NULL)
+		bytes += BUFSIZ;
+	if (replay != NULL)
+		bytes += itr.size;
+	if (query_memo != NULL)
+		bytes += QUERY_MEMO_SIZE * sizeof *query_memo;
+	return (bytes);
+}
+
+/*
+ * Print the peak memory used by each of our data structures.  Backends
+ * without nodes report their size themselves.
+ */
+static void
+fprintmem(FILE *f)
+{
+
+	if (cover->bytes != NULL)
+		fprintf(f, "peak memory: %s %.1f MiB, ", cover->name,
+		    cover->bytes(cset) / 1048576.0);
+	else
+		fprintf(f, "peak memory: tree %.1f MiB (%u nodes of %zu "
+		    "bytes), ", maxnodes * (double)node_bytes / 1048576,
+		    maxnodes, node_bytes);
+	fprintf(f, "queue %.1f MiB, stack %.1f MiB, buffers %.1f MiB\n",
+	    qsize * sizeof *queue / 1048576.0,
+	    maxrecurse * (double)frame_bytes / 1048576,
+	    buffer_bytes() / 1048576.0);
+}
+
+/*
+ * Print the insertion statistics: the number of times each outcome
+ * occurred, followed by the depth histogram.
+ */
+static void
+fprintinsstats(FILE *f)
+{
+	uintmax_t total;
+	unsigned int i, j, n;
+
+	fprintf(f, "%-9s %12s  depth histogram (log2 buckets)\n",
+	    "outcome", "count");
+	for (i = 0; i < INS_NOUTCOMES; ++i) {
+		for (total = 0, n = j = 0; j < DEPTH_BUCKETS; ++j)
+			if ((total += inshist[i][j]) > 0 && inshist[i][j] > 0)
+				n = j + 1;
+		fprintf(f, "%-9s %12ju ", outcome_name[i], total);
+		for (j = 0; j < n; ++j)
+			fprintf(f, " %ju", inshist[i][j]);
+		fprintf(f, "\n");
+	}
+}
+
+/*
+ * Print the number of new numbers and of numbers beyond the stop at
+ * each level, and the number of intervals in the set once the level
+ * was done if we know it.
+ */
+static void
+fprintlevels(FILE *f)
+{
+	unsigned int l;
+
+	if (nlevels == 0)
 		return;
-	collatz_r(num * 2);
-	if (--num % 6 == 3)
-		collatz_r(num / 3);
-	--depth;
+	fprintf(f, "%5s %12s %12s", "level", "numbers", "beyond");
+	if (LEVEL_INTERVALS)
+		fprintf(f, " %12s", "intervals");
+	fprintf(f, "\n");
+	for (l = 0; l < nlevels; ++l) {
+		fprintf(f, "%5u %12ju %12ju", l,
+		    levels[l].numbers, levels[l].beyond);
+		if (LEVEL_INTERVALS)
+			fprintf(f, " %12ju", levels[l].intervals);
+		fprintf(f, "\n");
+	}
+}
+
+/*
+ * Print the performance counters for each phase, in total and per
+ * number visited.
+ */
+static void
+fprintperf(FILE *f)
+{
+	uintmax_t visited;
+	unsigned int i, j;
+
+	if ((visited = COUNTER_LOAD(visited)) == 0)
+		visited = 1;
+	fprintf(f, "%-13s", "event");
+	for (j = 0; j < PHASE_NPHASES; ++j)
+		fprintf(f, " %16s", phase_name[j]);
+	fprintf(f, " %12s\n", "per number");
+	for (i = 0; i < PERF_NEVENTS; ++i) {
+		fprintf(f, "%-13s", perf_event_name[i]);
+		if (!perf_supported(&perf_main, i)) {
+			fprintf(f, " %16s\n", "not supported");
+			continue;
+		}
+		for (j = 0; j < PHASE_NPHASES; ++j)
+			fprintf(f, " %16ju", (uintmax_t)perf_phase[j].value[i]);
+		fprintf(f, " %12.1f\n", (double)(perf_phase[PHASE_TRAVERSAL].value[i] +
+		    perf_phase[PHASE_INSERT].value[i]) / visited);
+	}
+}
+
+/*
+ * Write a machine-readable summary of the run.
+ */
+static void
+report(FILE *f)
+{
+	struct rusage ru;
+	uintmax_t total, visited;
+	unsigned int i, j, n;
+	char buf[40];
+
+	getrusage(RUSAGE_SELF, &ru);
+	visited = COUNTER_LOAD(visited);
+	fprintf(f, "{\n");
+	fprintf(f, "  \"program\": \"%s\",\n", PACKAGE_NAME);
+	fprintf(f, "  \"version\": \"%s\",\n", PACKAGE_VERSION);
+	fprintf(f, "  \"engine\": \"%s\",\n", replay != NULL ? "replay" :
+	    opt_f ? "forward" : opt_D ? "delay" : opt_P ? "path" :
+	    query_path != NULL ? "query" :
+	    opt_i ? "iterative" : "recursive");
+	fprintf(f, "  \"map\": \"%un+%u\",\n", cmap.q, cmap.r);
+	if (!TREELESS)
+		fprintf(f, "  \"backend\": \"%s\",\n", cover->name);
+	fprintf(f, "  \"stop\": %ju,\n", stop);
+	fprintf(f, "  \"wall_time\": %.6f,\n", wall);
+	fprintf(f, "  \"user_time\": %.6f,\n",
+	    ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6);
+	fprintf(f, "  \"system_time\": %.6f,\n",
+	    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+	fprintf(f, "  \"visited\": %ju,\n", visited);
+	if (!TREELESS) {
+		fprintf(f, "  \"covered\": %ju,\n", cover->covered(cset));
+		fprintf(f, "  \"proven\": %ju,\n", cover->proven(cset));
+	} else if (treeless_proven()) {
+		fprintf(f, "  \"covered\": %ju,\n", stop - 1);
+		fprintf(f, "  \"proven\": %ju,\n", stop - 1);
+	}
+	fprintf(f, "  \"max_nodes\": %u,\n", maxnodes);
+	fprintf(f, "  \"max_depth\": %u,\n", maxdepth);
+	fprintf(f, "  \"max_recurse\": %u,\n", maxrecurse);
+	fprintf(f, "  \"max_queue\": %zu,\n", maxqueue);
+	fprintf(f, "  \"memory\": {\n");
+	fprintf(f, "    \"node_bytes\": %zu,\n", node_bytes);
+	fprintf(f, "    \"tree_peak\": %ju,\n", (uintmax_t)maxnodes * node_bytes);
+	if (!TREELESS && cover->bytes != NULL)
+		fprintf(f, "    \"%s_peak\": %ju,\n", cover->name,
+		    cover->bytes(cset));
+	fprintf(f, "    \"queue_peak\": %ju,\n", (uintmax_t)qsize * sizeof *queue);
+	fprintf(f, "    \"stack_peak\": %ju,\n", (uintmax_t)maxrecurse * frame_bytes);
+	fprintf(f, "    \"buffers\": %ju,\n", buffer_bytes());
+	fprintf(f, "    \"delay_cache\": %zu,\n", delay_cache_bytes());
+	fprintf(f, "    \"projected\": %ju\n",
+	    replay != NULL ? 0 : projected_memory());
+	fprintf(f, "  },\n");
+	if (!TREELESS && cover->fprintstats != NULL)
+		cover->fprintstats(f, cset);
+	fprintf(f, "  \"inserts\": {\n");
+	fprintf(f, "    \"new\": %ju,\n", visited - nfound - nbeyond);
+	fprintf(f, "    \"found\": %ju,\n", nfound);
+	fprintf(f, "    \"beyond_stop\": %ju\n", nbeyond);
+	fprintf(f, "  },\n");
+	if (opt_f) {
+		fprintf(f, "  \"forward\": {\n");
+		fprintf(f, "    \"kernel\": \"%s\",\n", KERNEL_NAME);
+		fprintf(f, "    \"lanes\": %d,\n", kernel->lanes);
+		fprintf(f, "    \"iterated\": %ju,\n", fwd.iterated);
+		fprintf(f, "    \"steps\": %ju,\n", fwd.steps);
+		fprintf(f, "    \"max_glide\": %ju,\n", fwd.maxsteps);
+		fprintf(f, "    \"max_glide_n\": %ju,\n", fwd.maxsteps_n);
+		fprintf(f, "    \"slow\": %ju,\n", fwd.slow);
+		fprintf(f, "    \"mp\": %ju,\n", fwd.mp);
+		fprintf(f, "    \"cycle_checks\": %ju,\n", fwd.brent);
+		fprintf(f, "    \"cycles\": [");
+		for (i = 0; i < fwd.ncycles; ++i)
+			fprintf(f, "%s%s", i > 0 ? ", " : "",
+			    u128str(buf, sizeof buf, fwd.cycle[i]));
+		fprintf(f, "],\n");
+		fprintf(f, "    \"divergent\": %ju,\n", fwd.divergent);
+		fprintf(f, "    \"divergent_n\": %ju\n", fwd.divergent_n);
+		fprintf(f, "  },\n");
+	}
+	if (query_path != NULL) {
+		fprintf(f, "  \"queries\": {\n");
+		fprintf(f, "    \"count\": %ju,\n", nqueries);
+		fprintf(f, "    \"reachable\": %ju,\n", nreachable);
+		fprintf(f, "    \"steps\": %ju,\n", query_steps);
+		fprintf(f, "    \"memo_hits\": %ju,\n", query_hits);
+		fprintf(f, "    \"memo_flushes\": %u,\n", query_flushes);
+		fprintf(f, "    \"rate\": %.0f\n",
+		    wall > 0 ? nqueries / wall : 0);
+		fprintf(f, "  },\n");
+	}
+	if (opt_D || opt_P) {
+		fprintf(f, "  \"threads\": %u,\n", nthreads);
+		fprintf(f, "  \"records\": [");
+		for (i = 0; i < nrecords; ++i)
+			fprintf(f, "%s\n    [%ju, %s]", i > 0 ? "," : "",
+			    records[i].n,
+			    u128str(buf, sizeof buf, records[i].value));
+		fprintf(f, "\n  ],\n");
+	}
+	if (nlevels > 0) {
+		fprintf(f, "  \"levels\": [");
+		for (i = 0; i < nlevels; ++i) {
+			fprintf(f, "%s\n    { \"numbers\": %ju, \"beyond\": %ju",
+			    i > 0 ? "," : "", levels[i].numbers,
+			    levels[i].beyond);
+			if (LEVEL_INTERVALS)
+				fprintf(f, ", \"intervals\": %ju",
+				    levels[i].intervals);
+			fprintf(f, " }");
+		}
+		fprintf(f, "\n  ],\n");
+	}
+	fprintf(f, "  \"insert_outcomes\": {\n");
+	for (i = 0; i < INS_NOUTCOMES; ++i) {
+		for (total = 0, n = j = 0; j < DEPTH_BUCKETS; ++j)
+			if ((total += inshist[i][j]) > 0 && inshist[i][j] > 0)
+				n = j + 1;
+		fprintf(f, "    \"%s\": { \"count\": %ju, \"depths\": [",
+		    outcome_name[i], total);
+		for (j = 0; j < n; ++j)
+			fprintf(f, "%s%ju", j > 0 ? ", " : "", inshist[i][j]);
+		fprintf(f, "] }%s\n", i < INS_NOUTCOMES - 1 ? "," : "");
+	}
+	fprintf(f, "  },\n");
+	if (opt_e) {
+		fprintf(f, "  \"perf\": {\n");
+		for (j = 0; j < PHASE_NPHASES; ++j) {
+			fprintf(f, "    \"%s\": {", phase_name[j]);
+			for (n = i = 0; i < PERF_NEVENTS; ++i) {
+				if (!perf_supported(&perf_main, i))
+					continue;
+				fprintf(f, "%s \"%s\": %ju", n++ ? "," : "",
+				    perf_event_name[i],
+				    (uintmax_t)perf_phase[j].value[i]);
+			}
+			fprintf(f, " }%s\n", j < PHASE_NPHASES - 1 ? "," : "");
+		}
+		fprintf(f, "  },\n");
+	}
+	/* Linux and BSD report ru_maxrss in kilobytes */
+	fprintf(f, "  \"peak_rss\": %ju\n", (uintmax_t)ru.ru_maxrss * 1024);
+	fprintf(f, "}\n");
+}
+
+/*
+ * Replay an insertion trace.
+ */
+static void
+collatz_replay(void)
+{
+	uintmax_t first, last;
+	int ret;
+
+	while ((ret = itrace_read(&itr, &first, &last)) > 0) {
+		COUNTER_INC(visited);
+		if (insert_range(first, last)) {
+			nfound++;
+			continue;
+		}
+		publish_insert();
+		debug("           ---\n");
+	}
+	if (ret < 0)
+		errx(1, "%s: invalid or truncated record at offset %zu",
+		    replay, itr.offset);
 }
 
 static void
 usage(void)
 {
 
-	fprintf(stderr, "usage: collatz [-drv] [log2max]\n");
+	fprintf(stderr,
+	    "usage: collatz [-deFiv] [-B backend] [-j file] "
+	    "[-m qn+r] [-t file]\n"
+	    "               [-T file] [-w file] [log2max]\n"
+	    "       collatz [-dev] [-j file] [-k kernel] [-m qn+r] [-t file] "
+	    "[-T file] -f [log2max]\n"
+	    "       collatz [-dev] [-c log2] [-C file] [-j file] [-n threads] "
+	    "[-o file]\n"
+	    "               [-t file] [-T file] -D [log2max]\n"
+	    "       collatz [-dev] [-j file] [-n threads] [-t file] [-T file] "
+	    "-P [log2max]\n"
+	    "       collatz [-dev] [-j file] [-t file] [-T file] -q file "
+	    "[log2max]\n"
+	    "       collatz [-deFv] [-B backend] [-j file] [-t file] "
+	    "[-T file] [-w file]\n"
+	    "               -R file\n");
 	exit(1);
 }
 
@@ -501,17 +1834,93 @@ main(int argc, char *argv[])
 	char *e;
 	int opt;
 
-	while ((opt = getopt(argc, argv, "div")) != -1)
+	while ((opt = getopt(argc, argv, "B:c:C:dDefFij:k:m:n:o:Pq:R:t:T:vw:")) != -1)
 		switch (opt) {
+		case 'B':
+			if ((cover = cover_select(optarg)) == NULL)
+				errx(1, "%s: no such backend", optarg);
+			break;
+		case 'c':
+			cache_bits = strtoul(optarg, &e, 10);
+			if (*optarg == '\0' || *e != '\0')
+				usage();
+			if (cache_bits <= STEP_BITS || cache_bits > DELAY_CACHE_MAX)
+				errx(1, "cache size must be between %u and %u",
+				    STEP_BITS + 1, DELAY_CACHE_MAX);
+			break;
+		case 'C':
+			cache_path = optarg;
+			break;
 		case 'd':
-			opt_d = true;
+			opt_d = tree_debug = true;
+			break;
+		case 'D':
+			opt_D = true;
+			break;
+		case 'e':
+			opt_e = true;
+			break;
+		case 'f':
+			opt_f = true;
+			break;
+		case 'F':
+			opt_F = true;
 			break;
 		case 'i':
 			opt_i = true;
 			break;
+		case 'j':
+			if (strcmp(optarg, "-") == 0)
+				jsf = stdout;
+			else if ((jsf = fopen(optarg, "w")) == NULL)
+				err(1, "%s", optarg);
+			break;
+		case 'k':
+			kernel_name = optarg;
+			break;
+		case 'm':
+			if (map_parse(&cmap, optarg) != 0)
+				errx(1, "%s: invalid map, expected qn+r with "
+				    "odd q and r", optarg);
+			break;
+		case 'n':
+			nthreads = strtoul(optarg, &e, 10);
+			if (*optarg == '\0' || *e != '\0' || nthreads < 1)
+				usage();
+			break;
+		case 'o':
+			table_path = optarg;
+			break;
+		case 'P':
+			opt_P = true;
+			break;
+		case 'q':
+			query_path = optarg;
+			break;
+		case 'R':
+			replay = optarg;
+			break;
+		case 't':
+			if ((trf = fopen(optarg, "w")) == NULL)
+				err(1, "%s", optarg);
+			trace_init(TRACE_EVENTS);
+			trace_thread("main");
+			break;
+		case 'T':
+			if ((tsf = fopen(optarg, "w")) == NULL)
+				err(1, "%s", optarg);
+			fprintf(tsf, "time,visited,covered,highest,proven,"
+			    "nodes,maxdepth,work,enqueued,dequeued,maxrss,"
+			    "visit_rate,insert_rate,enqueue_rate,dequeue_rate,"
+			    "frontier_rate,eta,level\n");
+			break;
 		case 'v':
 			opt_v = true;
 			break;
+		case 'w':
+			if (itrace_create(&itw, optarg) != 0)
+				err(1, "%s", optarg);
+			break;
 		default:
 			usage();
 		}
@@ -519,7 +1928,7 @@ main(int argc, char *argv[])
 	argc -= optind;
 	argv += optind;
 
-	if (argc == 1) {
+	if (argc == 1 && replay == NULL) {
 		log2max = strtoul(argv[0], &e, 10);
 		if (*argv[0] == '\0' || *e != '\0')
 			usage();
@@ -531,9 +1940,62 @@ main(int argc, char *argv[])
 
 	if (argc > 0)
 		usage();
+	if (TREELESS && (opt_i || replay != NULL || itw.f != NULL))
+		usage();
+	if (cover == NULL)
+		cover = cover_select("tree");
+	else if (TREELESS)
+		usage();
+	if (stop - 1 > cover->limit)
+		errx(1, "the %s backend only supports numbers up to %ju",
+		    cover->name, cover->limit);
+	if (opt_F && strcmp(cover->name, "tree") != 0)
+		usage();
+	if (opt_f + opt_D + opt_P + (query_path != NULL) > 1)
+		usage();
+	if ((opt_D || opt_P || query_path != NULL) && !map_classic(&cmap))
+		errx(1, "record searches and queries only support 3n+1");
+	if (table_path != NULL && !opt_D)
+		usage();
+	if (nthreads == 0) {
+		nthreads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ?
+		    sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	}
+	if (opt_f && (kernel = fwd_select(kernel_name)) == NULL)
+		errx(1, "%s: no such kernel or not supported by this CPU",
+		    kernel_name);
+	if (replay != NULL && itrace_open(&itr, replay) != 0)
+		err(1, "%s", replay);
 
+	if (opt_e) {
+		if (perf_open(&perf_main) < 0) {
+			warn("performance counters unavailable");
+			opt_e = false;
+		} else {
+			perf_calibrate(&perf_main, &perf_overhead);
+		}
+	}
+	if (table_path != NULL)
+		table_open();
 	tty = isatty(STDERR_FILENO);
 	collatz();
+	if (table_fd >= 0)
+		table_close();
+	if (jsf != NULL) {
+		report(jsf);
+		if (jsf != stdout)
+			fclose(jsf);
+	}
+	if (tsf != NULL)
+		fclose(tsf);
+	if (trf != NULL) {
+		if (trace_write(trf) != 0 || fclose(trf) != 0)
+			err(1, "trace");
+	}
+	if (itw.f != NULL && itrace_close(&itw) != 0)
+		err(1, "insertion trace");
+	if (replay != NULL)
+		(void)itrace_close(&itr);
 
 	exit(0);
 }
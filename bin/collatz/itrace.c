@@ -0,0 +1,210 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "itrace.h"
+
+#ifndef EFTYPE
+#define EFTYPE EINVAL
+#endif
+
+/*
+ * Write an unsigned integer in LEB128 encoding.
+ */
+static inline void
+itrace_put(FILE *f, uintmax_t num)
+{
+
+	while (num >= 0x80) {
+		putc_unlocked((int)(num & 0x7f) | 0x80, f);
+		num >>= 7;
+	}
+	putc_unlocked((int)num, f);
+}
+
+/*
+ * Read an unsigned integer in LEB128 encoding.
+ */
+static inline int
+itrace_get(itrace *it, uintmax_t *num)
+{
+	unsigned int shift;
+	uint8_t b;
+
+	*num = 0;
+	for (shift = 0; it->pos < it->size; shift += 7) {
+		b = it->buf[it->pos++];
+		if (shift < sizeof *num * 8)
+			*num |= (uintmax_t)(b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+			return (0);
+	}
+	errno = EFTYPE;
+	return (-1);
+}
+
+/*
+ * Create a trace file and write the header.
+ */
+int
+itrace_create(itrace *it, const char *path)
+{
+	uint8_t hdr[8];
+
+	memset(it, 0, sizeof *it);
+	if ((it->f = fopen(path, "w")) == NULL)
+		return (-1);
+	memcpy(hdr, ITRACE_MAGIC, 4);
+	hdr[4] = ITRACE_VERSION & 0xff;
+	hdr[5] = (ITRACE_VERSION >> 8) & 0xff;
+	hdr[6] = (ITRACE_VERSION >> 16) & 0xff;
+	hdr[7] = (ITRACE_VERSION >> 24) & 0xff;
+	if (fwrite(hdr, sizeof hdr, 1, it->f) != 1) {
+		fclose(it->f);
+		it->f = NULL;
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * Append a record.
+ */
+void
+itrace_write(itrace *it, uintmax_t first, uintmax_t last)
+{
+	uintmax_t delta;
+
+	/* zigzag encoding of the signed difference */
+	delta = first - it->prev;
+	delta = (delta << 1) ^ -(delta >> (sizeof delta * 8 - 1));
+	itrace_put(it->f, delta);
+	itrace_put(it->f, last - first);
+	it->prev = first;
+	it->count++;
+}
+
+/*
+ * Map a trace file into memory and check the header.
+ */
+int
+itrace_open(itrace *it, const char *path)
+{
+	struct stat st;
+	void *p;
+	int fd, serrno;
+
+	memset(it, 0, sizeof *it);
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return (-1);
+	if (fstat(fd, &st) != 0)
+		goto fail;
+	if (st.st_size < 8) {
+		errno = EFTYPE;
+		goto fail;
+	}
+	p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+	(void)close(fd);
+	(void)madvise(p, st.st_size, MADV_SEQUENTIAL);
+	it->buf = p;
+	it->size = st.st_size;
+	if (memcmp(it->buf, ITRACE_MAGIC, 4) != 0 ||
+	    (it->buf[4] | it->buf[5] << 8 | it->buf[6] << 16 |
+	    (uint32_t)it->buf[7] << 24) != ITRACE_VERSION) {
+		(void)itrace_close(it);
+		errno = EFTYPE;
+		return (-1);
+	}
+	it->pos = 8;
+	return (0);
+fail:
+	serrno = errno;
+	(void)close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+/*
+ * Read the next record.  Returns 1 if a record was read, 0 at the end of
+ * the trace and -1 if the trace is truncated or the record does not
+ * describe a valid range, in which case it->offset is the offset of
+ * the offending record.
+ */
+int
+itrace_read(itrace *it, uintmax_t *first, uintmax_t *last)
+{
+	uintmax_t delta, len;
+
+	if (it->pos == it->size)
+		return (0);
+	it->offset = it->pos;
+	if (itrace_get(it, &delta) != 0 || itrace_get(it, &len) != 0)
+		return (-1);
+	/* undo zigzag encoding */
+	delta = (delta >> 1) ^ -(delta & 1);
+	*first = it->prev + delta;
+	*last = *first + len;
+	if (*first == 0 || *last < *first) {
+		errno = EFTYPE;
+		return (-1);
+	}
+	it->prev = *first;
+	it->count++;
+	return (1);
+}
+
+/*
+ * Close a trace file, flushing it if we were writing.
+ */
+int
+itrace_close(itrace *it)
+{
+	int ret;
+
+	ret = 0;
+	if (it->f != NULL)
+		ret = fclose(it->f);
+	if (it->buf != NULL)
+		ret = munmap((void *)(uintptr_t)it->buf, it->size);
+	it->f = NULL;
+	it->buf = NULL;
+	return (ret);
+}
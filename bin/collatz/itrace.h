@@ -0,0 +1,61 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef ITRACE_H_INCLUDED
+#define ITRACE_H_INCLUDED
+
+/*
+ * Insertion trace
+ *
+ * A trace file starts with an eight-byte header consisting of the magic
+ * string "CLZI" followed by a 32-bit little-endian version number.  It
+ * is followed by one record per insertion, each consisting of two
+ * LEB128-encoded unsigned integers: the zigzag-encoded difference
+ * between the first number of the range and that of the previous
+ * record, and the difference between the last and first numbers.  A
+ * singleton close to the previous insertion therefore takes only a few
+ * bytes.
+ */
+#define ITRACE_MAGIC		"CLZI"
+#define ITRACE_VERSION		1
+
+typedef struct itrace {
+	FILE		*f;		/* writing */
+	const uint8_t	*buf;		/* reading */
+	size_t		 size;
+	size_t		 pos;
+	size_t		 offset;	/* of the last record read */
+	uintmax_t	 prev;
+	uintmax_t	 count;
+} itrace;
+
+int itrace_create(itrace *, const char *);
+void itrace_write(itrace *, uintmax_t, uintmax_t);
+int itrace_open(itrace *, const char *);
+int itrace_read(itrace *, uintmax_t *, uintmax_t *);
+int itrace_close(itrace *);
+
+#endif
@@ -0,0 +1,195 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if HAVE_LINUX_PERF_EVENT_H
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "perf.h"
+
+#define PERF_CALIBRATION_ROUNDS	256
+
+const char *perf_event_name[PERF_NEVENTS] = {
+	[PERF_CYCLES]		= "cycles",
+	[PERF_INSTRUCTIONS]	= "instructions",
+	[PERF_CACHE_MISSES]	= "cache-misses",
+	[PERF_BRANCH_MISSES]	= "branch-misses",
+	[PERF_DTLB_MISSES]	= "dtlb-misses",
+	[PERF_TASK_CLOCK]	= "task-clock",
+};
+
+#if HAVE_LINUX_PERF_EVENT_H
+static const struct {
+	uint32_t	 type;
+	uint64_t	 config;
+} perf_event_attrs[PERF_NEVENTS] = {
+	[PERF_CYCLES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES
+	},
+	[PERF_INSTRUCTIONS] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS
+	},
+	[PERF_CACHE_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES
+	},
+	[PERF_BRANCH_MISSES] = {
+		PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES
+	},
+	[PERF_DTLB_MISSES] = {
+		PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+		    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)
+	},
+	[PERF_TASK_CLOCK] = {
+		PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK
+	},
+};
+#endif
+
+/*
+ * Open and start a set of counters for the calling thread.  Threads it
+ * creates afterwards are counted too, but only once they have exited.
+ * Events which the kernel or hardware does not support are quietly
+ * skipped.  Returns the number of events successfully opened, or -1 if
+ * none were.
+ */
+int
+perf_open(perf_counters *pc)
+{
+#if HAVE_LINUX_PERF_EVENT_H
+	struct perf_event_attr attr;
+	int i, n;
+
+	for (n = i = 0; i < PERF_NEVENTS; ++i) {
+		memset(&attr, 0, sizeof attr);
+		attr.size = sizeof attr;
+		attr.type = perf_event_attrs[i].type;
+		attr.config = perf_event_attrs[i].config;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.inherit = 1;
+		pc->fd[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+		    PERF_FLAG_FD_CLOEXEC);
+		if (pc->fd[i] >= 0)
+			n++;
+	}
+	if (n == 0) {
+		errno = ENOTSUP;
+		return (-1);
+	}
+	return (n);
+#else
+	int i;
+
+	for (i = 0; i < PERF_NEVENTS; ++i)
+		pc->fd[i] = -1;
+	errno = ENOSYS;
+	return (-1);
+#endif
+}
+
+/*
+ * Read the current value of each counter.  Unsupported events read as 0.
+ */
+void
+perf_read(const perf_counters *pc, perf_values *pv)
+{
+	int i;
+
+	for (i = 0; i < PERF_NEVENTS; ++i)
+		if (pc->fd[i] < 0 || read(pc->fd[i], &pv->value[i],
+		    sizeof pv->value[i]) != sizeof pv->value[i])
+			pv->value[i] = 0;
+}
+
+/*
+ * Add the difference between two readings to a running total.
+ */
+void
+perf_accumulate(perf_values *total, const perf_values *from,
+    const perf_values *to)
+{
+	int i;
+
+	for (i = 0; i < PERF_NEVENTS; ++i)
+		total->value[i] += to->value[i] - from->value[i];
+}
+
+/*
+ * Estimate the cost of a pair of back-to-back readings, which is
+ * included in every measurement of a short section of code.
+ */
+void
+perf_calibrate(const perf_counters *pc, perf_values *overhead)
+{
+	perf_values before, after, total;
+	int i, n;
+
+	memset(&total, 0, sizeof total);
+	for (n = 0; n < PERF_CALIBRATION_ROUNDS; ++n) {
+		perf_read(pc, &before);
+		perf_read(pc, &after);
+		perf_accumulate(&total, &before, &after);
+	}
+	for (i = 0; i < PERF_NEVENTS; ++i)
+		overhead->value[i] = total.value[i] / PERF_CALIBRATION_ROUNDS;
+}
+
+/*
+ * Returns true if the specified event is being counted.
+ */
+bool
+perf_supported(const perf_counters *pc, enum perf_event ev)
+{
+
+	return (pc->fd[ev] >= 0);
+}
+
+/*
+ * Stop and close a set of counters.
+ */
+void
+perf_close(perf_counters *pc)
+{
+	int i;
+
+	for (i = 0; i < PERF_NEVENTS; ++i) {
+		if (pc->fd[i] >= 0)
+			(void)close(pc->fd[i]);
+		pc->fd[i] = -1;
+	}
+}
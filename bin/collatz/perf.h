@@ -0,0 +1,68 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef PERF_H_INCLUDED
+#define PERF_H_INCLUDED
+
+/*
+ * Hardware performance counters
+ */
+enum perf_event {
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_CACHE_MISSES,
+	PERF_BRANCH_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_TASK_CLOCK,
+	PERF_NEVENTS
+};
+
+extern const char *perf_event_name[PERF_NEVENTS];
+
+/*
+ * A set of counters attached to the calling thread.  A descriptor of -1
+ * indicates an event which is not supported on this system.
+ */
+typedef struct perf_counters {
+	int		 fd[PERF_NEVENTS];
+} perf_counters;
+
+/*
+ * Counter values, or the difference between two sets of values.
+ */
+typedef struct perf_values {
+	uint64_t	 value[PERF_NEVENTS];
+} perf_values;
+
+int perf_open(perf_counters *);
+void perf_read(const perf_counters *, perf_values *);
+void perf_accumulate(perf_values *, const perf_values *,
+    const perf_values *);
+void perf_calibrate(const perf_counters *, perf_values *);
+bool perf_supported(const perf_counters *, enum perf_event);
+void perf_close(perf_counters *);
+
+#endif
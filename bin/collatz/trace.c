@@ -0,0 +1,181 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "trace.h"
+
+typedef struct trace_rec {
+	uint64_t	 ts;		/* nanoseconds since trace_init() */
+	const char	*name;
+	uint64_t	 value;		/* counter value */
+	char		 type;		/* Chrome trace phase */
+} trace_rec;
+
+typedef struct trace_buf {
+	struct trace_buf *next;
+	char		*name;		/* thread name */
+	unsigned int	 tid;
+	size_t		 head;		/* total events recorded */
+	trace_rec	 rec[];
+} trace_buf;
+
+bool trace_enabled;
+
+static size_t trace_size;
+static struct timespec trace_epoch;
+static pthread_mutex_t trace_mtx = PTHREAD_MUTEX_INITIALIZER;
+static trace_buf *trace_bufs;
+static unsigned int trace_tids;
+static __thread trace_buf *trace_self;
+
+/*
+ * Enable tracing with the specified number of events per thread.
+ */
+void
+trace_init(size_t size)
+{
+
+	trace_size = size;
+	clock_gettime(CLOCK_MONOTONIC, &trace_epoch);
+	trace_enabled = true;
+}
+
+/*
+ * Allocate a ring buffer for the calling thread.  Threads which record
+ * events without calling this first get one with a generic name.  The
+ * name is copied, since the thread may not outlive the trace.
+ */
+void
+trace_thread(const char *name)
+{
+	trace_buf *tb;
+
+	if (!trace_enabled || trace_self != NULL)
+		return;
+	if ((tb = calloc(1, sizeof *tb + trace_size * sizeof *tb->rec)) == NULL)
+		err(1, "calloc()");
+	if ((tb->name = strdup(name)) == NULL)
+		err(1, "strdup()");
+	pthread_mutex_lock(&trace_mtx);
+	tb->tid = ++trace_tids;
+	tb->next = trace_bufs;
+	trace_bufs = tb;
+	pthread_mutex_unlock(&trace_mtx);
+	trace_self = tb;
+}
+
+/*
+ * Returns the amount of memory allocated for ring buffers.
+ */
+size_t
+trace_bytes(void)
+{
+	size_t bytes;
+	trace_buf *tb;
+
+	bytes = 0;
+	pthread_mutex_lock(&trace_mtx);
+	for (tb = trace_bufs; tb != NULL; tb = tb->next)
+		bytes += sizeof *tb + trace_size * sizeof *tb->rec;
+	pthread_mutex_unlock(&trace_mtx);
+	return (bytes);
+}
+
+/*
+ * Record an event.
+ */
+void
+trace_event(char type, const char *name, uint64_t value)
+{
+	struct timespec now;
+	trace_rec *tr;
+
+	if (trace_self == NULL)
+		trace_thread("thread");
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	tr = &trace_self->rec[trace_self->head++ % trace_size];
+	tr->ts = (now.tv_sec - trace_epoch.tv_sec) * 1000000000ULL +
+	    now.tv_nsec - trace_epoch.tv_nsec;
+	tr->name = name;
+	tr->value = value;
+	tr->type = type;
+}
+
+/*
+ * Write all recorded events in Chrome trace JSON format.  This must not
+ * run concurrently with threads that are still recording.
+ */
+int
+trace_write(FILE *f)
+{
+	trace_buf *tb;
+	trace_rec *tr;
+	size_t i;
+	bool comma;
+
+	comma = false;
+	fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	for (tb = trace_bufs; tb != NULL; tb = tb->next) {
+		fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\","
+		    "\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+		    comma ? ",\n" : "", tb->tid, tb->name);
+		comma = true;
+		if (tb->head > trace_size)
+			fprintf(f, ",\n{\"name\":\"events dropped\",\"ph\":\"i\","
+			    "\"s\":\"t\",\"pid\":1,\"tid\":%u,\"ts\":0,"
+			    "\"args\":{\"count\":%zu}}",
+			    tb->tid, tb->head - trace_size);
+		i = tb->head > trace_size ? tb->head - trace_size : 0;
+		for (; i < tb->head; ++i) {
+			tr = &tb->rec[i % trace_size];
+			fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\","
+			    "\"pid\":1,\"tid\":%u,\"ts\":%" PRIu64 ".%03u",
+			    tr->name, tr->type, tb->tid,
+			    tr->ts / 1000, (unsigned int)(tr->ts % 1000));
+			if (tr->type == 'C')
+				fprintf(f, ",\"args\":{\"%s\":%" PRIu64 "}",
+				    tr->name, tr->value);
+			else if (tr->type == 'i')
+				fprintf(f, ",\"s\":\"t\"");
+			fprintf(f, "}");
+		}
+	}
+	fprintf(f, "\n]}\n");
+	return (ferror(f) ? -1 : 0);
+}
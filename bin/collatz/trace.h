@@ -0,0 +1,55 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+/*
+ * Event trace in Chrome trace format
+ *
+ * Each thread records events into its own ring buffer, so recording
+ * involves no locking and no allocation; when a buffer fills up, the
+ * oldest events are overwritten.  Event names must be string constants
+ * or otherwise outlive the trace; thread names are copied.
+ */
+extern bool trace_enabled;
+
+void trace_init(size_t);
+void trace_thread(const char *);
+void trace_event(char, const char *, uint64_t);
+size_t trace_bytes(void);
+int trace_write(FILE *);
+
+#define trace_begin(name) \
+	do { if (trace_enabled) trace_event('B', (name), 0); } while (0)
+#define trace_end(name) \
+	do { if (trace_enabled) trace_event('E', (name), 0); } while (0)
+#define trace_instant(name) \
+	do { if (trace_enabled) trace_event('i', (name), 0); } while (0)
+#define trace_counter(name, value) \
+	do { if (trace_enabled) trace_event('C', (name), (value)); } while (0)
+
+#endif
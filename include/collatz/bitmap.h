@@ -0,0 +1,56 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_BITMAP_H_INCLUDED
+#define COLLATZ_BITMAP_H_INCLUDED
+
+/*
+ * Set of reachable numbers kept as a bitmap with one bit per number,
+ * grown as needed.  Inserts and lookups take constant time, and memory
+ * use depends only on the highest number, not on how fragmented the
+ * set is.  There are no nodes; the bitmap's size is reported instead.
+ */
+typedef struct bitmap {
+	uint64_t	*word;
+	size_t		 nwords;
+	uintmax_t	 covered;	/* numbers in the set */
+	uintmax_t	 intervals;	/* runs of consecutive numbers */
+	uintmax_t	 highest;	/* highest number in the set */
+	uintmax_t	 proven;	/* end of the range starting at 1 */
+} bitmap;
+
+/* initial size: enough for 2^22 numbers */
+#define BITMAP_MIN_WORDS	(1<<16)
+/* largest number we will make room for: 8 GiB worth */
+#define BITMAP_MAX		(((uintmax_t)1 << 36) - 1)
+
+void bitmap_init(bitmap *, uintmax_t, uintmax_t);
+void bitmap_destroy(bitmap *);
+bool bitmap_insert(bitmap *, uintmax_t, uintmax_t);
+bool bitmap_lookup(const bitmap *, uintmax_t);
+void bitmap_fprint(FILE *, const bitmap *);
+
+#endif
@@ -0,0 +1,70 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_COVER_H_INCLUDED
+#define COLLATZ_COVER_H_INCLUDED
+
+/*
+ * Coverage backends: interchangeable implementations of the set of
+ * reached numbers, each described by a table of operations on an
+ * opaque state.  The optional operations may be NULL.
+ */
+typedef struct cover_ops {
+	const char	*name;
+	uintmax_t	 limit;		/* largest number supported */
+	/* create a set containing one interval */
+	void		*(*init)(uintmax_t, uintmax_t, unsigned int);
+	void		 (*destroy)(void *);
+	/* insert a range, returning true if it was already covered */
+	bool		 (*insert)(void *, uintmax_t, uintmax_t);
+	bool		 (*lookup)(void *, uintmax_t);
+	/* optional: look up several numbers at once */
+	void		 (*lookup_batch)(void *, const uintmax_t *, bool *,
+			    unsigned int);
+	/* optional: bring lookups and statistics up to date */
+	void		 (*flush)(void *);
+	/* print the intervals in order */
+	void		 (*fprint)(FILE *, void *);
+	/* optional: print backend-specific JSON members */
+	void		 (*fprintstats)(FILE *, void *);
+	uintmax_t	 (*covered)(void *);
+	uintmax_t	 (*highest)(void *);
+	uintmax_t	 (*proven)(void *);
+	/* optional: number of disjoint intervals in the set */
+	uintmax_t	 (*intervals)(void *);
+	/* optional: peak memory use, for backends without nodes */
+	uintmax_t	 (*bytes)(void *);
+	/* projected memory use for a given stop */
+	uintmax_t	 (*projected)(uintmax_t);
+} cover_ops;
+
+/* flags for init */
+#define COVER_NOFINGER		0x01	/* tree: always insert from the root */
+
+extern const cover_ops *cover_backends[];
+const cover_ops *cover_select(const char *);
+
+#endif
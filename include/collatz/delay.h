@@ -0,0 +1,50 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_DELAY_H_INCLUDED
+#define COLLATZ_DELAY_H_INCLUDED
+
+/*
+ * Total stopping time (delay): the number of steps of the standard map,
+ * n / 2 for even n and 3n + 1 for odd n, needed to reach 1.
+ *
+ * Trajectories are advanced STEP_BITS steps of the shortcut map T at a
+ * time: if x = 2^k a + b, then T^k(x) = 3^c a + T^k(b), where c is the
+ * number of odd values among the first k iterates of b.  Once a
+ * trajectory drops below 2^delay_bits, the rest of its delay is looked
+ * up in a cache of the delays of all odd numbers below that.
+ */
+#define STEP_BITS		16
+#define DELAY_CACHE_BITS	21	/* default, 2 MiB */
+#define DELAY_CACHE_MAX		34	/* 16 GiB */
+
+extern unsigned int delay_bits;
+
+int delay_init(unsigned int, const char *);
+size_t delay_cache_bytes(void);
+unsigned int delay(uint64_t);
+
+#endif
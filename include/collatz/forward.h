@@ -0,0 +1,90 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_FORWARD_H_INCLUDED
+#define COLLATZ_FORWARD_H_INCLUDED
+
+/*
+ * Forward verification
+ *
+ * A number is verified when its trajectory under T(x) = x / 2 for even
+ * x and (3x + 1) / 2 for odd x drops below its starting value; by
+ * induction, every number below the stop then reaches 1.  Even numbers
+ * and numbers congruent to 1 mod 4 drop below themselves within two
+ * steps, so only numbers congruent to 3 mod 4 are actually iterated.
+ *
+ * For other maps qn + r, only even numbers can be skipped, and there is
+ * no guarantee that a trajectory ever drops below its start: it may
+ * enter a cycle whose smallest member is its start or above, or
+ * diverge.  After FWD_CYCLE_BUDGET steps, the generic kernel starts
+ * looking for cycles using Brent's algorithm, and a trajectory which
+ * outgrows the multi-precision fallback, or spends more than
+ * FWD_MP_BUDGET steps in it, is considered to diverge.
+ */
+#define FWD_CYCLE_BUDGET	1024
+#define FWD_MP_BUDGET		(1 << 20)
+#define FWD_CYCLES_MAX		64
+
+typedef struct fwd_result {
+	uintmax_t	 numbers;	/* numbers verified */
+	uintmax_t	 iterated;	/* numbers actually iterated */
+	uintmax_t	 steps;		/* total steps taken */
+	uintmax_t	 maxsteps;	/* longest glide */
+	uintmax_t	 maxsteps_n;	/* number with the longest glide */
+	uintmax_t	 slow;		/* trajectories which overflowed */
+	uintmax_t	 mp;		/* ...even 128 bits */
+	uintmax_t	 brent;		/* trajectories checked for cycles */
+	uintmax_t	 divergent;	/* trajectories which diverged */
+	uintmax_t	 divergent_n;	/* smallest such */
+	unsigned int	 ncycles;	/* cycles found */
+	unsigned __int128 cycle[FWD_CYCLES_MAX];	/* their minima */
+} fwd_result;
+
+/*
+ * A kernel verifies all numbers in [first, last] and adds its results
+ * to the result structure.
+ */
+typedef void (*fwd_kernel)(uint64_t, uint64_t, fwd_result *);
+
+typedef struct fwd_kernel_desc {
+	const char	*name;
+	fwd_kernel	 func;
+	int		 lanes;
+	bool		(*supported)(void);
+} fwd_kernel_desc;
+
+/*
+ * Values above this may overflow 64 bits on the next step.
+ */
+#define FWD_LIMIT		0xaaaaaaaaaaaaaaa9ULL
+
+const fwd_kernel_desc *fwd_select(const char *);
+void fwd_merge(fwd_result *, const fwd_result *);
+void fwd_slow(uint64_t, uint64_t, unsigned int, fwd_result *);
+unsigned __int128 fwd_peak(uint64_t);
+void fwd_map(uint64_t, uint64_t, unsigned int, unsigned int, fwd_result *);
+
+#endif
@@ -0,0 +1,110 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_LSM_H_INCLUDED
+#define COLLATZ_LSM_H_INCLUDED
+
+/*
+ * Log-structured recorder for the set of reached numbers.
+ *
+ * The reverse graph is a tree except for the cycle through 1, so the
+ * only numbers the reverse engines can reach a second time are those
+ * they started with.  The recorder therefore answers inserts without
+ * searching anything: ranges are appended to a buffer, and a full
+ * buffer is handed to a background thread which sorts it, coalesces it
+ * into a run of disjoint intervals and merges that run into a stack of
+ * runs whose sizes grow geometrically, like the levels of an LSM tree.
+ *
+ * The coverage, frontier and interval count are updated by the
+ * background thread as it goes, so they lag behind the inserts until
+ * lsm_flush() is called.  The runs overlap until then, so the node
+ * count is only updated by lsm_flush(), to the number of intervals.
+ */
+typedef struct interval {
+	uintmax_t	 first;
+	uintmax_t	 last;
+} interval;
+
+typedef struct run {
+	interval	*iv;
+	size_t		 len;
+	uintmax_t	 covered;
+} run;
+
+/* intervals per append buffer */
+#define LSM_BUFFER		(1<<20)
+/* level i holds the result of merging up to 2^i buffers */
+#define LSM_LEVELS		48
+
+typedef struct lsm {
+	uintmax_t	 first;		/* initial interval */
+	uintmax_t	 last;
+	uintmax_t	 highest;	/* highest number inserted */
+	interval	*buf[2];	/* append buffers */
+	unsigned int	 cur;		/* buffer being appended to */
+	size_t		 len;		/* intervals in it */
+	interval	*pending;	/* buffer handed to the compactor */
+	size_t		 npending;
+	interval	*scratch;	/* the compactor's sort buffer */
+	run		 level[LSM_LEVELS];
+	bool		 done;		/* compactor should exit */
+	bool		 running;	/* compactor has been started */
+	pthread_t	 thread;
+	pthread_mutex_t	 mtx;
+	pthread_cond_t	 cv;
+	atomic_uintmax_t covered;
+	atomic_uintmax_t proven;
+	atomic_uintmax_t intervals;
+	atomic_uintmax_t merges;
+} lsm;
+
+void lsm_init(lsm *, uintmax_t, uintmax_t);
+void lsm_destroy(lsm *);
+void lsm_handoff(lsm *);
+void lsm_flush(lsm *);
+bool lsm_lookup(const lsm *, uintmax_t);
+void lsm_fprint(FILE *, const lsm *);
+
+/*
+ * Record a range.  Returns true if it lies within the initial interval,
+ * which is the only way it can have been reached before.
+ */
+static inline bool
+lsm_insert(lsm *s, uintmax_t first, uintmax_t last)
+{
+
+	if (first >= s->first && last <= s->last)
+		return (true);
+	if (last > s->highest)
+		s->highest = last;
+	s->buf[s->cur][s->len].first = first;
+	s->buf[s->cur][s->len].last = last;
+	if (++s->len == LSM_BUFFER)
+		lsm_handoff(s);
+	return (false);
+}
+
+#endif
@@ -0,0 +1,71 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_MAP_H_INCLUDED
+#define COLLATZ_MAP_H_INCLUDED
+
+/*
+ * Generalized Collatz maps: n / 2 for even n, qn + r for odd n, where q
+ * and r are both odd so that qn + r is always even.  The predecessors
+ * of m are 2m and, if m - r ≡ q mod 2q, the odd number (m - r) / q.
+ *
+ * The helpers below take q and r as arguments so that callers which
+ * pass constants get code specialized for that map.
+ */
+typedef struct map {
+	unsigned int	 q;
+	unsigned int	 r;
+} map;
+
+#define MAP_Q_MAX		999
+#define MAP_R_MAX		999999
+
+int map_parse(map *, const char *);
+
+/*
+ * Return true and store the odd predecessor of m in *p if it has one.
+ */
+static inline bool
+map_pred(uintmax_t m, unsigned int q, unsigned int r, uintmax_t *p)
+{
+
+	if (m <= r || (m - r) % (2 * q) != q)
+		return (false);
+	*p = (m - r) / q;
+	return (true);
+}
+
+/*
+ * Return true if the map is the classic 3n + 1.
+ */
+static inline bool
+map_classic(const map *m)
+{
+
+	return (m->q == 3 && m->r == 1);
+}
+
+#endif
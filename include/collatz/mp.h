@@ -0,0 +1,49 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_MP_H_INCLUDED
+#define COLLATZ_MP_H_INCLUDED
+
+/*
+ * Multi-precision fallback for trajectories which outgrow 128 bits.
+ * Numbers have a fixed number of 64-bit limbs, least significant
+ * first; a trajectory which outgrows even that is considered to
+ * diverge.
+ */
+#define MP_LIMBS		8
+#define MP_BITS			(MP_LIMBS * 64)
+
+typedef struct mp {
+	uint64_t	 limb[MP_LIMBS];
+	unsigned int	 len;		/* limbs in use */
+} mp;
+
+int mp_descend(unsigned __int128 *, unsigned int, unsigned int,
+    unsigned int, uintmax_t, uintmax_t *, uintmax_t *);
+int mp_peak(unsigned __int128 *, unsigned int, unsigned int,
+    unsigned int, unsigned __int128 *);
+
+#endif
@@ -0,0 +1,59 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_SPLAY_H_INCLUDED
+#define COLLATZ_SPLAY_H_INCLUDED
+
+/*
+ * Set of reachable numbers kept as a splay tree of disjoint,
+ * non-adjacent intervals ordered by their first number.  Every access
+ * moves the interval it touched to the root, so a traversal which keeps
+ * returning to the same neighbourhood finds it near the top.
+ *
+ * The node counts and the deepest access path are accounted for in the
+ * same statistics as the interval tree.
+ */
+typedef struct snode {
+	uintmax_t	 first;
+	uintmax_t	 last;
+	struct snode	*left;
+	struct snode	*right;
+} snode;
+
+typedef struct splay {
+	snode		*root;
+	uintmax_t	 covered;	/* numbers in the set */
+	uintmax_t	 highest;	/* highest number in the set */
+	uintmax_t	 proven;	/* end of the interval starting at 1 */
+} splay;
+
+void splay_init(splay *, uintmax_t, uintmax_t);
+void splay_destroy(splay *);
+bool splay_insert(splay *, uintmax_t, uintmax_t);
+bool splay_lookup(splay *, uintmax_t);
+void splay_fprint(FILE *, const splay *);
+
+#endif
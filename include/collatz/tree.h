@@ -0,0 +1,91 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef COLLATZ_TREE_H_INCLUDED
+#define COLLATZ_TREE_H_INCLUDED
+
+/*
+ * Tree of reachable numbers
+ */
+typedef struct node {
+	uintmax_t	 first;
+	uintmax_t	 last;
+	uintmax_t	 covered;
+	unsigned int	 depth;
+	struct node	*left;
+	struct node	*right;
+} node;
+
+#define LEAF_NODE(n)	((n)->left == NULL && (n)->right == NULL)
+
+/*
+ * Finger: the path from the root to the last leaf touched by an insert
+ */
+typedef struct finger {
+	node		**path;
+	unsigned int	 len, size;
+	uintmax_t	 hits;		/* inserts which did not start at the root */
+} finger;
+
+extern bool tree_debug;
+extern node *proven;
+extern unsigned int nodes, maxnodes, maxdepth;
+extern size_t node_bytes;	/* memory used per node */
+
+/*
+ * Insertion statistics: for each possible outcome of a step in insert(),
+ * a histogram of the depths at which it occurred.  Bucket 0 holds depth
+ * 0, bucket i > 0 holds depths 2^(i-1) through 2^i - 1.
+ */
+enum outcome {
+	INS_TRIVIAL,		/* trivially found */
+	INS_SUBRANGE,		/* found in a leaf */
+	INS_EXPAND,		/* leaf expanded */
+	INS_SPLIT,		/* leaf split */
+	INS_COALESCE,		/* range bridged the gap between children */
+	INS_ABSORB,		/* leaf absorbed while bridging */
+	INS_LEFT,		/* descended into left child */
+	INS_RIGHT,		/* descended into right child */
+	INS_SHALLOW,		/* descended into shallowest child */
+	INS_NOUTCOMES
+};
+#define DEPTH_BUCKETS		(sizeof(unsigned int) * 8 + 1)
+extern const char *outcome_name[INS_NOUTCOMES];
+extern uintmax_t inshist[INS_NOUTCOMES][DEPTH_BUCKETS];
+
+void fprintnodes(FILE *, const node *);
+node *create(unsigned int, uintmax_t, uintmax_t);
+void destroy(node *);
+bool insert(node *, uintmax_t, uintmax_t);
+bool finger_insert(finger *, node *, uintmax_t, uintmax_t);
+void finger_free(finger *);
+bool lookup(const node *, uintmax_t);
+
+/* maximum number of descents lookup_batch() will interleave */
+#define LOOKUP_BATCH_MAX	64
+void lookup_batch(const node *, const uintmax_t *, bool *, unsigned int);
+
+#endif
@@ -0,0 +1,171 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <collatz/bitmap.h>
+
+#define BIT_WORD(n)		((n) / 64)
+#define BIT_MASK(n)		((uint64_t)1 << ((n) % 64))
+
+static void bitmap_grow(bitmap *, uintmax_t);
+static uintmax_t bitmap_next(const bitmap *, uintmax_t, bool);
+
+/*
+ * Make sure the bitmap covers the specified number, doubling its size
+ * as often as necessary.
+ */
+static void
+bitmap_grow(bitmap *b, uintmax_t num)
+{
+	uint64_t *nw;
+	size_t size;
+
+	if (BIT_WORD(num) < b->nwords)
+		return;
+	if (num > BITMAP_MAX)
+		errx(1, "bitmap cannot hold %ju", num);
+	for (size = b->nwords ? b->nwords : BITMAP_MIN_WORDS;
+	    size <= BIT_WORD(num); size *= 2)
+		/* nothing */ ;
+	if ((nw = realloc(b->word, size * sizeof *nw)) == NULL)
+		err(1, "realloc()");
+	memset(nw + b->nwords, 0, (size - b->nwords) * sizeof *nw);
+	b->word = nw;
+	b->nwords = size;
+}
+
+/*
+ * Returns the first number at or above n which is in the set, if set
+ * is true, or not in it, if set is false, looking at a word at a time.
+ * Returns the number just past the end of the bitmap if there is none.
+ */
+static uintmax_t
+bitmap_next(const bitmap *b, uintmax_t n, bool set)
+{
+	uint64_t w;
+	size_t i;
+
+	for (i = BIT_WORD(n); i < b->nwords; ++i) {
+		w = set ? b->word[i] : ~b->word[i];
+		if (i == BIT_WORD(n))
+			w &= ~(uint64_t)0 << (n % 64);
+		if (w != 0)
+			return ((uintmax_t)i * 64 + __builtin_ctzll(w));
+	}
+	return ((uintmax_t)b->nwords * 64);
+}
+
+/*
+ * Initialize a set containing a single interval.
+ */
+void
+bitmap_init(bitmap *b, uintmax_t first, uintmax_t last)
+{
+
+	memset(b, 0, sizeof *b);
+	(void)bitmap_insert(b, first, last);
+}
+
+/*
+ * Free the bitmap.
+ */
+void
+bitmap_destroy(bitmap *b)
+{
+
+	free(b->word);
+	memset(b, 0, sizeof *b);
+}
+
+/*
+ * Insert a range.  Returns true if it was entirely in the set already.
+ */
+bool
+bitmap_insert(bitmap *b, uintmax_t first, uintmax_t last)
+{
+	uintmax_t n, added;
+
+	assert(first <= last);
+	bitmap_grow(b, last);
+	for (added = 0, n = first; n <= last; ++n) {
+		if ((b->word[BIT_WORD(n)] & BIT_MASK(n)) == 0) {
+			/* a new run, unless we extend or join existing ones */
+			b->intervals += 1;
+			b->intervals -= n > 0 && bitmap_lookup(b, n - 1);
+			b->intervals -= bitmap_lookup(b, n + 1);
+			b->word[BIT_WORD(n)] |= BIT_MASK(n);
+			added++;
+		}
+	}
+	if (added == 0)
+		return (true);
+	b->covered += added;
+	if (last > b->highest)
+		b->highest = last;
+	/* advance the frontier over whatever is now contiguous */
+	if (first <= b->proven + 1 && bitmap_lookup(b, 1))
+		b->proven = bitmap_next(b, b->proven + 1, false) - 1;
+	return (false);
+}
+
+/*
+ * Returns true if the specified number is in the set.
+ */
+bool
+bitmap_lookup(const bitmap *b, uintmax_t num)
+{
+
+	return (BIT_WORD(num) < b->nwords &&
+	    (b->word[BIT_WORD(num)] & BIT_MASK(num)) != 0);
+}
+
+/*
+ * Print out the set as a list of intervals.
+ */
+void
+bitmap_fprint(FILE *f, const bitmap *b)
+{
+	uintmax_t first, end, n;
+
+	end = (uintmax_t)b->nwords * 64;
+	for (n = bitmap_next(b, 0, true); n < end;
+	    n = bitmap_next(b, n, true)) {
+		first = n;
+		n = bitmap_next(b, n, false);
+		fprintf(f, "[%ju, %ju]\n", first, n - 1);
+	}
+}
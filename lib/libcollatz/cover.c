@@ -0,0 +1,527 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <collatz/bitmap.h>
+#include <collatz/cover.h>
+#include <collatz/lsm.h>
+#include <collatz/splay.h>
+#include <collatz/tree.h>
+
+/*
+ * Empirically, the interval tree peaks at about 0.424 nodes per number
+ * below the stop.  About half of those are leaves, i.e. intervals.
+ */
+#define PROJECTED_NODES(stop)	((stop) / 1000 * 424)
+
+static void *
+cover_alloc(size_t size)
+{
+	void *p;
+
+	if ((p = calloc(1, size)) == NULL)
+		err(1, "calloc()");
+	return (p);
+}
+
+/*
+ * Interval tree, inserting from a finger unless told otherwise
+ */
+struct cover_tree {
+	node		*root;
+	finger		 fg;
+	bool		 nofinger;
+};
+
+static void *
+tree_init(uintmax_t first, uintmax_t last, unsigned int flags)
+{
+	struct cover_tree *t;
+
+	t = cover_alloc(sizeof *t);
+	t->root = create(0, first, last);
+	t->nofinger = flags & COVER_NOFINGER;
+	return (t);
+}
+
+static void
+tree_destroy(void *p)
+{
+	struct cover_tree *t = p;
+
+	destroy(t->root);
+	finger_free(&t->fg);
+	free(t);
+}
+
+static bool
+tree_insert(void *p, uintmax_t first, uintmax_t last)
+{
+	struct cover_tree *t = p;
+
+	if (t->nofinger)
+		return (insert(t->root, first, last));
+	return (finger_insert(&t->fg, t->root, first, last));
+}
+
+static bool
+tree_lookup(void *p, uintmax_t num)
+{
+	struct cover_tree *t = p;
+
+	return (lookup(t->root, num));
+}
+
+static void
+tree_lookup_batch(void *p, const uintmax_t *num, bool *found,
+    unsigned int count)
+{
+	struct cover_tree *t = p;
+
+	lookup_batch(t->root, num, found, count);
+}
+
+static void
+tree_fprint(FILE *f, void *p)
+{
+	struct cover_tree *t = p;
+
+	fprintnodes(f, t->root);
+}
+
+static void
+tree_fprintstats(FILE *f, void *p)
+{
+	struct cover_tree *t = p;
+
+	fprintf(f, "  \"finger\": %s,\n", t->nofinger ? "false" : "true");
+	fprintf(f, "  \"finger_hits\": %ju,\n", t->fg.hits);
+}
+
+static uintmax_t
+tree_covered(void *p)
+{
+	struct cover_tree *t = p;
+
+	return (t->root->covered);
+}
+
+static uintmax_t
+tree_highest(void *p)
+{
+	struct cover_tree *t = p;
+
+	return (t->root->last);
+}
+
+static uintmax_t
+tree_proven(void *p)
+{
+
+	(void)p;
+	return (proven->last);
+}
+
+/*
+ * Every internal node has two children, so there is one leaf more than
+ * there are internal nodes.
+ */
+static uintmax_t
+tree_intervals(void *p)
+{
+
+	(void)p;
+	return ((nodes + 1) / 2);
+}
+
+static uintmax_t
+tree_projected(uintmax_t stop)
+{
+
+	return (PROJECTED_NODES(stop) * node_bytes);
+}
+
+static const cover_ops tree_ops = {
+	.name		= "tree",
+	.limit		= UINTMAX_MAX,
+	.init		= tree_init,
+	.destroy	= tree_destroy,
+	.insert		= tree_insert,
+	.lookup		= tree_lookup,
+	.lookup_batch	= tree_lookup_batch,
+	.fprint		= tree_fprint,
+	.fprintstats	= tree_fprintstats,
+	.covered	= tree_covered,
+	.highest	= tree_highest,
+	.proven		= tree_proven,
+	.intervals	= tree_intervals,
+	.projected	= tree_projected,
+};
+
+/*
+ * Splay tree
+ */
+static void *
+splay_cover_init(uintmax_t first, uintmax_t last, unsigned int flags)
+{
+	splay *s;
+
+	(void)flags;
+	s = cover_alloc(sizeof *s);
+	splay_init(s, first, last);
+	return (s);
+}
+
+static void
+splay_cover_destroy(void *p)
+{
+
+	splay_destroy(p);
+	free(p);
+}
+
+static bool
+splay_cover_insert(void *p, uintmax_t first, uintmax_t last)
+{
+
+	return (splay_insert(p, first, last));
+}
+
+static bool
+splay_cover_lookup(void *p, uintmax_t num)
+{
+
+	return (splay_lookup(p, num));
+}
+
+static void
+splay_cover_fprint(FILE *f, void *p)
+{
+
+	splay_fprint(f, p);
+}
+
+static uintmax_t
+splay_cover_covered(void *p)
+{
+
+	return (((splay *)p)->covered);
+}
+
+static uintmax_t
+splay_cover_highest(void *p)
+{
+
+	return (((splay *)p)->highest);
+}
+
+static uintmax_t
+splay_cover_proven(void *p)
+{
+
+	return (((splay *)p)->proven);
+}
+
+static uintmax_t
+splay_cover_intervals(void *p)
+{
+
+	(void)p;
+	return (nodes);
+}
+
+static uintmax_t
+splay_cover_projected(uintmax_t stop)
+{
+
+	/* no internal nodes */
+	return (PROJECTED_NODES(stop) / 2 * node_bytes);
+}
+
+static const cover_ops splay_ops = {
+	.name		= "splay",
+	.limit		= UINTMAX_MAX,
+	.init		= splay_cover_init,
+	.destroy	= splay_cover_destroy,
+	.insert		= splay_cover_insert,
+	.lookup		= splay_cover_lookup,
+	.fprint		= splay_cover_fprint,
+	.covered	= splay_cover_covered,
+	.highest	= splay_cover_highest,
+	.proven		= splay_cover_proven,
+	.intervals	= splay_cover_intervals,
+	.projected	= splay_cover_projected,
+};
+
+/*
+ * Log-structured recorder
+ */
+static void *
+lsm_cover_init(uintmax_t first, uintmax_t last, unsigned int flags)
+{
+	lsm *s;
+
+	(void)flags;
+	s = cover_alloc(sizeof *s);
+	lsm_init(s, first, last);
+	return (s);
+}
+
+static void
+lsm_cover_destroy(void *p)
+{
+
+	lsm_destroy(p);
+	free(p);
+}
+
+static bool
+lsm_cover_insert(void *p, uintmax_t first, uintmax_t last)
+{
+
+	return (lsm_insert(p, first, last));
+}
+
+static bool
+lsm_cover_lookup(void *p, uintmax_t num)
+{
+
+	return (lsm_lookup(p, num));
+}
+
+static void
+lsm_cover_flush(void *p)
+{
+
+	lsm_flush(p);
+}
+
+static void
+lsm_cover_fprint(FILE *f, void *p)
+{
+
+	lsm_fprint(f, p);
+}
+
+static void
+lsm_cover_fprintstats(FILE *f, void *p)
+{
+	lsm *s = p;
+
+	fprintf(f, "  \"merges\": %ju,\n",
+	    (uintmax_t)atomic_load(&s->merges));
+}
+
+static uintmax_t
+lsm_cover_covered(void *p)
+{
+	lsm *s = p;
+
+	return (atomic_load_explicit(&s->covered, memory_order_relaxed));
+}
+
+static uintmax_t
+lsm_cover_highest(void *p)
+{
+
+	return (((lsm *)p)->highest);
+}
+
+static uintmax_t
+lsm_cover_proven(void *p)
+{
+	lsm *s = p;
+
+	return (atomic_load_explicit(&s->proven, memory_order_relaxed));
+}
+
+static uintmax_t
+lsm_cover_projected(uintmax_t stop)
+{
+
+	/* half the nodes, but merging needs twice that, plus the buffers */
+	return (PROJECTED_NODES(stop) * sizeof(interval) +
+	    3 * LSM_BUFFER * sizeof(interval));
+}
+
+static const cover_ops lsm_ops = {
+	.name		= "lsm",
+	.limit		= UINTMAX_MAX,
+	.init		= lsm_cover_init,
+	.destroy	= lsm_cover_destroy,
+	.insert		= lsm_cover_insert,
+	.lookup		= lsm_cover_lookup,
+	.flush		= lsm_cover_flush,
+	.fprint		= lsm_cover_fprint,
+	.fprintstats	= lsm_cover_fprintstats,
+	.covered	= lsm_cover_covered,
+	.highest	= lsm_cover_highest,
+	.proven		= lsm_cover_proven,
+	.projected	= lsm_cover_projected,
+};
+
+/*
+ * Bitmap
+ */
+static void *
+bitmap_cover_init(uintmax_t first, uintmax_t last, unsigned int flags)
+{
+	bitmap *b;
+
+	(void)flags;
+	b = cover_alloc(sizeof *b);
+	bitmap_init(b, first, last);
+	return (b);
+}
+
+static void
+bitmap_cover_destroy(void *p)
+{
+
+	bitmap_destroy(p);
+	free(p);
+}
+
+static bool
+bitmap_cover_insert(void *p, uintmax_t first, uintmax_t last)
+{
+
+	return (bitmap_insert(p, first, last));
+}
+
+static bool
+bitmap_cover_lookup(void *p, uintmax_t num)
+{
+
+	return (bitmap_lookup(p, num));
+}
+
+static void
+bitmap_cover_fprint(FILE *f, void *p)
+{
+
+	bitmap_fprint(f, p);
+}
+
+static uintmax_t
+bitmap_cover_covered(void *p)
+{
+
+	return (((bitmap *)p)->covered);
+}
+
+static uintmax_t
+bitmap_cover_highest(void *p)
+{
+
+	return (((bitmap *)p)->highest);
+}
+
+static uintmax_t
+bitmap_cover_proven(void *p)
+{
+
+	return (((bitmap *)p)->proven);
+}
+
+static uintmax_t
+bitmap_cover_intervals(void *p)
+{
+
+	return (((bitmap *)p)->intervals);
+}
+
+/*
+ * The bitmap never shrinks, so its current size is its peak.
+ */
+static uintmax_t
+bitmap_cover_bytes(void *p)
+{
+	bitmap *b = p;
+
+	return ((uintmax_t)b->nwords * sizeof *b->word);
+}
+
+static uintmax_t
+bitmap_cover_projected(uintmax_t stop)
+{
+	uintmax_t words;
+
+	/* the bitmap doubles in size when full */
+	for (words = BITMAP_MIN_WORDS; words * 64 < stop; words *= 2)
+		/* nothing */ ;
+	return (words * sizeof(uint64_t));
+}
+
+static const cover_ops bitmap_ops = {
+	.name		= "bitmap",
+	.limit		= BITMAP_MAX,
+	.init		= bitmap_cover_init,
+	.destroy	= bitmap_cover_destroy,
+	.insert		= bitmap_cover_insert,
+	.lookup		= bitmap_cover_lookup,
+	.fprint		= bitmap_cover_fprint,
+	.covered	= bitmap_cover_covered,
+	.highest	= bitmap_cover_highest,
+	.proven		= bitmap_cover_proven,
+	.intervals	= bitmap_cover_intervals,
+	.bytes		= bitmap_cover_bytes,
+	.projected	= bitmap_cover_projected,
+};
+
+const cover_ops *cover_backends[] = {
+	&tree_ops,
+	&splay_ops,
+	&lsm_ops,
+	&bitmap_ops,
+	NULL
+};
+
+/*
+ * Look up a backend by name.
+ */
+const cover_ops *
+cover_select(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; cover_backends[i] != NULL; ++i)
+		if (strcmp(cover_backends[i]->name, name) == 0)
+			return (cover_backends[i]);
+	return (NULL);
+}
@@ -0,0 +1,297 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <collatz/delay.h>
+#include <collatz/mp.h>
+
+#ifndef EFTYPE
+#define EFTYPE EINVAL
+#endif
+
+#define STEP_SIZE		((uint64_t)1 << STEP_BITS)
+#define STEP_MASK		(STEP_SIZE - 1)
+
+/*
+ * Above this, a k-step jump may overflow 64 bits: 3^16 < 2^26 and
+ * T^16(b) < 2^26 for b < 2^16.
+ */
+#define DELAY_FAST_BITS		54
+
+/* ...and above this, it may overflow 128 bits */
+#define DELAY_SLOW_BITS		100
+
+static uint8_t step_odd[STEP_SIZE];	/* c for each b */
+static uint32_t step_value[STEP_SIZE];	/* T^k(b) for each b */
+static uint64_t pow3[STEP_BITS + 1];
+
+/*
+ * Small-n cache: the delay of each odd n below 2^delay_bits, indexed by
+ * n / 2.  When saved to a file, the entries follow a header and are in
+ * native byte order; the version field doubles as a byte order check.
+ */
+struct delay_header {
+	char		 magic[4];
+	uint32_t	 version;
+	uint32_t	 bits;
+	uint32_t	 reserved;
+};
+#define DELAY_MAGIC		"CLZD"
+#define DELAY_VERSION		1
+
+unsigned int delay_bits;
+static uint64_t cache_limit;
+static uint16_t *cache;
+static size_t cache_size;	/* including the header if mapped */
+
+static uint64_t delay_slow(uint64_t, uint64_t, unsigned int *);
+
+/*
+ * Advance a trajectory by STEP_BITS steps.  The caller must ensure that
+ * x >= STEP_SIZE, so that the trajectory does not reach 1 before the
+ * last of those steps.
+ */
+static inline uint64_t
+delay_jump(uint64_t n, uint64_t x, unsigned int *steps)
+{
+	uint64_t b;
+
+	if (x >> DELAY_FAST_BITS)
+		return (delay_slow(n, x, steps));
+	b = x & STEP_MASK;
+	*steps += STEP_BITS + step_odd[b];
+	return (pow3[step_odd[b]] * (x >> STEP_BITS) + step_value[b]);
+}
+
+/*
+ * Continue a trajectory which would overflow 64 bits, using 128-bit
+ * arithmetic until it has come back down.
+ */
+static uint64_t
+delay_slow(uint64_t n, uint64_t x, unsigned int *steps)
+{
+	unsigned __int128 y;
+	uintmax_t total, odd;
+	uint64_t b;
+
+	for (y = x; y >> DELAY_FAST_BITS; ) {
+		if (y >> DELAY_SLOW_BITS) {
+			/* and multi-precision beyond that */
+			total = odd = 0;
+			if (mp_descend(&y, 3, 1, DELAY_SLOW_BITS, 0,
+			    &total, &odd) != 0)
+				errx(1, "trajectory of %ju exceeds %d bits",
+				    (uintmax_t)n, MP_BITS);
+			*steps += total + odd;
+			continue;
+		}
+		b = (uint64_t)y & STEP_MASK;
+		*steps += STEP_BITS + step_odd[b];
+		y = pow3[step_odd[b]] * (y >> STEP_BITS) + step_value[b];
+	}
+	return ((uint64_t)y);
+}
+
+/*
+ * Fill the cache in ascending order: each trajectory is followed until
+ * it drops below its start, where the rest of its delay is known.
+ */
+static void
+delay_fill(void)
+{
+	unsigned int steps, s;
+	uint64_t i, n, x;
+
+	cache[0] = 0;
+	for (i = 1; i < cache_limit / 2; ++i) {
+		n = 2 * i + 1;
+		for (x = n, steps = 0; x >= n; ) {
+			if (x >= STEP_SIZE) {
+				x = delay_jump(n, x, &steps);
+			} else if (x & 1) {
+				x = x + (x >> 1) + 1;
+				steps += 2;
+			} else {
+				x >>= 1;
+				steps++;
+			}
+		}
+		s = __builtin_ctzll(x);
+		cache[i] = steps + s + cache[(x >> s) / 2];
+	}
+}
+
+/*
+ * Map a previously saved cache, or create, fill and save a new one.  An
+ * interrupted run leaves a file with no header, since that is written
+ * last, or one shorter than its header says; such a file is rebuilt.
+ * A file with a foreign magic or unsupported parameters is an error.
+ */
+static int
+delay_map(const char *path, unsigned int bits)
+{
+	static const struct delay_header nohdr;
+	struct delay_header hdr;
+	struct stat st;
+	bool fresh;
+	void *p;
+	int fd, serrno;
+
+	if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0)
+		return (-1);
+	if (fstat(fd, &st) != 0)
+		goto fail;
+	fresh = true;
+	if (st.st_size > 0 &&
+	    pread(fd, &hdr, sizeof hdr, 0) == (ssize_t)sizeof hdr &&
+	    memcmp(hdr.magic, nohdr.magic, sizeof hdr.magic) != 0) {
+		if (memcmp(hdr.magic, DELAY_MAGIC, sizeof hdr.magic) != 0 ||
+		    hdr.version != DELAY_VERSION ||
+		    hdr.bits <= STEP_BITS || hdr.bits > DELAY_CACHE_MAX) {
+			errno = EFTYPE;
+			goto fail;
+		}
+		if ((uintmax_t)st.st_size == sizeof hdr +
+		    ((uintmax_t)1 << (hdr.bits - 1)) * sizeof *cache) {
+			bits = hdr.bits;
+			fresh = false;
+		}
+	}
+	if (fresh && (ftruncate(fd, 0) != 0 || ftruncate(fd, sizeof hdr +
+	    ((off_t)1 << (bits - 1)) * sizeof *cache) != 0))
+		goto fail;
+	delay_bits = bits;
+	cache_limit = (uint64_t)1 << bits;
+	cache_size = sizeof hdr + cache_limit / 2 * sizeof *cache;
+	p = mmap(NULL, cache_size, fresh ? PROT_READ | PROT_WRITE :
+	    PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED)
+		goto fail;
+	close(fd);
+	cache = (uint16_t *)((char *)p + sizeof hdr);
+	if (fresh) {
+		delay_fill();
+		/* the header goes last, so an incomplete file is rebuilt */
+		memset(&hdr, 0, sizeof hdr);
+		memcpy(hdr.magic, DELAY_MAGIC, sizeof hdr.magic);
+		hdr.version = DELAY_VERSION;
+		hdr.bits = bits;
+		memcpy(p, &hdr, sizeof hdr);
+		if (msync(p, cache_size, MS_SYNC) != 0 ||
+		    mprotect(p, cache_size, PROT_READ) != 0)
+			return (-1);
+	}
+	return (0);
+fail:
+	serrno = errno;
+	close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+/*
+ * Build the step tables and the small-n cache, which covers the odd
+ * numbers below 2^bits.  If a path is given, the cache is loaded from
+ * that file if it exists, in which case its size overrides the one
+ * requested, or saved to it if it does not.  Must be called before
+ * delay(), and before any threads which call it are started.  Returns
+ * 0 on success and -1 if the file could not be loaded or saved.
+ */
+int
+delay_init(unsigned int bits, const char *path)
+{
+	uint64_t b, x;
+	unsigned int i, c;
+
+	if (cache != NULL)
+		return (0);
+	for (pow3[0] = 1, i = 1; i <= STEP_BITS; ++i)
+		pow3[i] = pow3[i - 1] * 3;
+	for (b = 0; b < STEP_SIZE; ++b) {
+		for (x = b, c = i = 0; i < STEP_BITS; ++i) {
+			if (x & 1) {
+				x = x + (x >> 1) + 1;
+				c++;
+			} else {
+				x >>= 1;
+			}
+		}
+		step_odd[b] = c;
+		step_value[b] = x;
+	}
+	if (path != NULL)
+		return (delay_map(path, bits));
+	delay_bits = bits;
+	cache_limit = (uint64_t)1 << bits;
+	cache_size = cache_limit / 2 * sizeof *cache;
+	if ((cache = malloc(cache_size)) == NULL)
+		err(1, "malloc()");
+	delay_fill();
+	return (0);
+}
+
+/*
+ * Memory used by the small-n cache.
+ */
+size_t
+delay_cache_bytes(void)
+{
+
+	return (cache_size);
+}
+
+/*
+ * Compute the delay of n.
+ */
+unsigned int
+delay(uint64_t n)
+{
+	unsigned int steps, s;
+	uint64_t x;
+
+	if (n == 0)
+		return (0);
+	steps = __builtin_ctzll(n);
+	for (x = n >> steps; x >= cache_limit; )
+		x = delay_jump(n, x, &steps);
+	s = __builtin_ctzll(x);
+	return (steps + s + cache[(x >> s) / 2]);
+}
@@ -0,0 +1,507 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define FWD_X86 1
+#endif
+
+#include <collatz/forward.h>
+#include <collatz/mp.h>
+
+/*
+ * Record the end of a glide.
+ */
+static inline void
+fwd_done(fwd_result *res, uint64_t n, uintmax_t steps)
+{
+
+	res->iterated++;
+	res->steps += steps;
+	if (steps > res->maxsteps) {
+		res->maxsteps = steps;
+		res->maxsteps_n = n;
+	}
+}
+
+/*
+ * Count the numbers in [first, last] which need no iteration, and
+ * return the first candidate, i.e. the first number congruent to 3 mod
+ * 4 which is no less than first.
+ */
+static inline uint64_t
+fwd_prepare(uint64_t first, uint64_t last, fwd_result *res)
+{
+
+	if (first < 3)
+		first = 3;
+	if (last < first)
+		return (UINT64_MAX);
+	res->numbers += last - first + 1;
+	return (first + ((3 - first) & 3));
+}
+
+/*
+ * Continue a trajectory which would overflow 64 bits, using 128-bit
+ * arithmetic.
+ */
+void
+fwd_slow(uint64_t n, uint64_t x, unsigned int steps, fwd_result *res)
+{
+	unsigned __int128 y;
+	uintmax_t total, odd;
+	bool wide;
+
+	res->slow++;
+	for (y = x, total = steps, wide = false; y >= n; total++) {
+		if (y >> 126) {
+			/* and multi-precision beyond that */
+			if (mp_descend(&y, 3, 1, 126, 0, &total, &odd) != 0)
+				errx(1, "trajectory of %ju exceeds %d bits",
+				    (uintmax_t)n, MP_BITS);
+			wide = true;
+			if (y < n)
+				break;
+		}
+		y = (y & 1) ? y + (y >> 1) + 1 : y >> 1;
+	}
+	if (wide)
+		res->mp++;
+	fwd_done(res, n, total);
+}
+
+/*
+ * Compute the highest value reached by the trajectory of n under the
+ * standard map before it drops below n, which is also the highest value
+ * it ever reaches unless that was already reached from a smaller
+ * number.  For odd n, this is twice the highest value reached under T,
+ * since every peak of the standard map is 3x + 1 for some odd x.
+ * Trajectories which outgrow 128 bits continue in multi-precision, but
+ * the peak itself must still fit.
+ */
+unsigned __int128
+fwd_peak(uint64_t n)
+{
+	unsigned __int128 y, ymax;
+	uint64_t x, xmax;
+
+	if (n < 3)
+		return (n);
+	if (n % 2 == 0)
+		return (n);
+	for (x = xmax = n; x >= n; ) {
+		if (x > FWD_LIMIT)
+			break;
+		if (x & 1) {
+			x = x + (x >> 1) + 1;
+			if (x > xmax)
+				xmax = x;
+		} else {
+			x >>= 1;
+		}
+	}
+	if (x < n)
+		return ((unsigned __int128)xmax * 2);
+	for (y = x, ymax = xmax; y >= n; ) {
+		if (y >> 126) {
+			if (mp_peak(&y, 3, 1, 126, &ymax) != 0 || ymax >> 127)
+				errx(1, "peak of %ju exceeds 128 bits",
+				    (uintmax_t)n);
+			if (y < n)
+				break;
+		}
+		if (y & 1) {
+			y = y + (y >> 1) + 1;
+			if (y > ymax)
+				ymax = y;
+		} else {
+			y >>= 1;
+		}
+	}
+	return (ymax * 2);
+}
+
+/*
+ * Scalar kernel.
+ */
+static void
+fwd_scalar(uint64_t first, uint64_t last, fwd_result *res)
+{
+	uint64_t n, x;
+	unsigned int steps;
+
+	for (n = fwd_prepare(first, last, res); n <= last && n >= first;
+	    n += 4) {
+		for (x = n, steps = 0; x >= n; steps++) {
+			if (x > FWD_LIMIT)
+				break;
+			x = (x & 1) ? x + (x >> 1) + 1 : x >> 1;
+		}
+		if (x >= n)
+			fwd_slow(n, x, steps, res);
+		else
+			fwd_done(res, n, steps);
+	}
+}
+
+static bool
+fwd_scalar_supported(void)
+{
+
+	return (true);
+}
+
+#if FWD_X86
+/*
+ * AVX2 kernel: four trajectories in parallel, each lane being refilled
+ * with the next candidate as soon as its trajectory drops below its
+ * starting value.  AVX2 has no unsigned 64-bit comparison, so both
+ * sides are offset by 2^63 and compared as signed.
+ */
+__attribute__((__target__("avx2")))
+static void
+fwd_avx2(uint64_t first, uint64_t last, fwd_result *res)
+{
+	uint64_t xs[4], ns[4], ss[4], next;
+	__m256i x, n, s, one, sign, limit, odd, t, h, done, over;
+	unsigned int i, m, active;
+
+	next = fwd_prepare(first, last, res);
+	one = _mm256_set1_epi64x(1);
+	sign = _mm256_set1_epi64x((int64_t)(1ULL << 63));
+	limit = _mm256_set1_epi64x((int64_t)(FWD_LIMIT ^ (1ULL << 63)));
+	for (active = i = 0; i < 4; ++i) {
+		ss[i] = 0;
+		if (next <= last && next >= first) {
+			xs[i] = ns[i] = next;
+			next += 4;
+			active |= 1U << i;
+		} else {
+			/* idle lane: 0 < 1 is done immediately */
+			xs[i] = 0;
+			ns[i] = 1;
+		}
+	}
+	while (active) {
+		x = _mm256_loadu_si256((const __m256i *)xs);
+		n = _mm256_loadu_si256((const __m256i *)ns);
+		s = _mm256_loadu_si256((const __m256i *)ss);
+		for (;;) {
+			odd = _mm256_cmpeq_epi64(_mm256_and_si256(x, one), one);
+			h = _mm256_srli_epi64(x, 1);
+			t = _mm256_add_epi64(_mm256_add_epi64(x, h), one);
+			x = _mm256_blendv_epi8(h, t, odd);
+			s = _mm256_add_epi64(s, one);
+			done = _mm256_cmpgt_epi64(_mm256_xor_si256(n, sign),
+			    _mm256_xor_si256(x, sign));
+			over = _mm256_cmpgt_epi64(_mm256_xor_si256(x, sign),
+			    limit);
+			if (!_mm256_testz_si256(_mm256_or_si256(done, over),
+			    _mm256_or_si256(done, over)))
+				break;
+		}
+		_mm256_storeu_si256((__m256i *)xs, x);
+		_mm256_storeu_si256((__m256i *)ss, s);
+		m = _mm256_movemask_pd(_mm256_castsi256_pd(
+		    _mm256_or_si256(done, over)));
+		for (m &= active; m != 0; m &= m - 1) {
+			i = __builtin_ctz(m);
+			if (xs[i] >= ns[i])
+				fwd_slow(ns[i], xs[i], ss[i], res);
+			else
+				fwd_done(res, ns[i], ss[i]);
+			ss[i] = 0;
+			if (next <= last && next >= first) {
+				xs[i] = ns[i] = next;
+				next += 4;
+			} else {
+				xs[i] = 0;
+				ns[i] = 1;
+				active &= ~(1U << i);
+			}
+		}
+	}
+}
+
+static bool
+fwd_avx2_supported(void)
+{
+
+	return (__builtin_cpu_supports("avx2"));
+}
+
+/*
+ * AVX-512 kernel: same as the AVX2 kernel, with eight lanes and native
+ * unsigned comparisons and masks.
+ */
+__attribute__((__target__("avx512f")))
+static void
+fwd_avx512(uint64_t first, uint64_t last, fwd_result *res)
+{
+	uint64_t xs[8], ns[8], ss[8], next;
+	__m512i x, n, s, one, limit, t, h;
+	__mmask8 odd, m;
+	unsigned int i, active;
+
+	next = fwd_prepare(first, last, res);
+	one = _mm512_set1_epi64(1);
+	limit = _mm512_set1_epi64((int64_t)FWD_LIMIT);
+	for (active = i = 0; i < 8; ++i) {
+		ss[i] = 0;
+		if (next <= last && next >= first) {
+			xs[i] = ns[i] = next;
+			next += 4;
+			active |= 1U << i;
+		} else {
+			xs[i] = 0;
+			ns[i] = 1;
+		}
+	}
+	while (active) {
+		x = _mm512_loadu_si512(xs);
+		n = _mm512_loadu_si512(ns);
+		s = _mm512_loadu_si512(ss);
+		do {
+			odd = _mm512_test_epi64_mask(x, one);
+			h = _mm512_srli_epi64(x, 1);
+			t = _mm512_add_epi64(_mm512_add_epi64(x, h), one);
+			x = _mm512_mask_blend_epi64(odd, h, t);
+			s = _mm512_add_epi64(s, one);
+			m = _mm512_cmplt_epu64_mask(x, n) |
+			    _mm512_cmpgt_epu64_mask(x, limit);
+		} while (m == 0);
+		_mm512_storeu_si512(xs, x);
+		_mm512_storeu_si512(ss, s);
+		for (m &= active; m != 0; m &= m - 1) {
+			i = __builtin_ctz(m);
+			if (xs[i] >= ns[i])
+				fwd_slow(ns[i], xs[i], ss[i], res);
+			else
+				fwd_done(res, ns[i], ss[i]);
+			ss[i] = 0;
+			if (next <= last && next >= first) {
+				xs[i] = ns[i] = next;
+				next += 4;
+			} else {
+				xs[i] = 0;
+				ns[i] = 1;
+				active &= ~(1U << i);
+			}
+		}
+	}
+}
+
+static bool
+fwd_avx512_supported(void)
+{
+
+	return (__builtin_cpu_supports("avx512f"));
+}
+#endif
+
+/*
+ * Available kernels, best first.
+ */
+static const fwd_kernel_desc fwd_kernels[] = {
+#if FWD_X86
+	{ "avx512", fwd_avx512, 8, fwd_avx512_supported },
+	{ "avx2", fwd_avx2, 4, fwd_avx2_supported },
+#endif
+	{ "scalar", fwd_scalar, 1, fwd_scalar_supported },
+	{ NULL, NULL, 0, NULL },
+};
+
+/*
+ * Record a cycle by its smallest member, unless we already know it.
+ */
+static void
+fwd_cycle(fwd_result *res, unsigned __int128 min)
+{
+	unsigned int i;
+
+	for (i = 0; i < res->ncycles; ++i)
+		if (res->cycle[i] == min)
+			return;
+	if (res->ncycles < FWD_CYCLES_MAX)
+		res->cycle[res->ncycles++] = min;
+}
+
+/*
+ * One step of T for the map qn + r.  Returns -1 instead if the result
+ * would exceed 128 bits, i.e. if y is odd and greater than lim.
+ */
+static inline int
+fwd_map_step(unsigned __int128 *y, unsigned int q, unsigned int r,
+    unsigned __int128 lim)
+{
+
+	if ((*y & 1) == 0) {
+		*y >>= 1;
+		return (0);
+	}
+	if (*y > lim)
+		return (-1);
+	*y = (*y * q + r) >> 1;
+	return (1);
+}
+
+/*
+ * Generic kernel for the map qn + r: follow each odd number's
+ * trajectory until it drops below its start, enters a cycle, or
+ * diverges.
+ */
+void
+fwd_map(uint64_t first, uint64_t last, unsigned int q, unsigned int r,
+    fwd_result *res)
+{
+	unsigned __int128 y, lim, tortoise, min;
+	uintmax_t steps, power, lam, odd, i;
+	uint64_t n;
+	bool cycle, diverged, wide;
+
+	lim = (~(unsigned __int128)0 - r) / q;
+	if (last < first)
+		return;
+	res->numbers += last - first + 1;
+	for (n = first | 1; n <= last && n >= first; n += 2) {
+		y = n;
+		steps = 0;
+		power = lam = 1;
+		tortoise = 0;
+		cycle = diverged = wide = false;
+		while (y >= n) {
+			if (fwd_map_step(&y, q, r, lim) < 0) {
+				/* keep going in multi-precision */
+				wide = true;
+				if (mp_descend(&y, q, r, 126, FWD_MP_BUDGET,
+				    &steps, &odd) != 0) {
+					diverged = true;
+					break;
+				}
+				/* only look for cycles within 128 bits */
+				if (steps >= FWD_CYCLE_BUDGET) {
+					tortoise = y;
+					power = lam = 1;
+				}
+				continue;
+			}
+			if (++steps < FWD_CYCLE_BUDGET)
+				continue;
+			/* Brent: the tortoise waits at powers of two */
+			if (steps == FWD_CYCLE_BUDGET) {
+				res->brent++;
+				tortoise = y;
+				continue;
+			}
+			if (y == tortoise) {
+				cycle = true;
+				break;
+			}
+			if (power == lam) {
+				tortoise = y;
+				power *= 2;
+				lam = 0;
+			}
+			lam++;
+		}
+		if (wide)
+			res->mp++;
+		if (y < n) {
+			fwd_done(res, n, steps);
+		} else if (cycle) {
+			/* walk the cycle once to find its smallest member */
+			for (min = y, i = 0; i < lam; ++i) {
+				(void)fwd_map_step(&y, q, r, lim);
+				if (y < min)
+					min = y;
+			}
+			fwd_cycle(res, min);
+		} else if (diverged) {
+			if (res->divergent++ == 0 || n < res->divergent_n)
+				res->divergent_n = n;
+		}
+	}
+}
+
+/*
+ * Select a kernel by name, or the best one supported by this CPU if the
+ * name is NULL or "auto".  Returns NULL if the requested kernel does
+ * not exist or is not supported.
+ */
+const fwd_kernel_desc *
+fwd_select(const char *name)
+{
+	const fwd_kernel_desc *k;
+
+	for (k = fwd_kernels; k->name != NULL; ++k) {
+		if (name != NULL && strcmp(name, "auto") != 0 &&
+		    strcmp(name, k->name) != 0)
+			continue;
+		if (k->supported())
+			return (k);
+		if (name != NULL && strcmp(name, "auto") != 0)
+			return (NULL);
+	}
+	return (NULL);
+}
+
+/*
+ * Merge two sets of results.
+ */
+void
+fwd_merge(fwd_result *to, const fwd_result *from)
+{
+	unsigned int i;
+
+	to->numbers += from->numbers;
+	to->iterated += from->iterated;
+	to->steps += from->steps;
+	if (from->maxsteps > to->maxsteps ||
+	    (from->maxsteps == to->maxsteps &&
+	    from->maxsteps_n < to->maxsteps_n)) {
+		to->maxsteps = from->maxsteps;
+		to->maxsteps_n = from->maxsteps_n;
+	}
+	to->slow += from->slow;
+	to->mp += from->mp;
+	to->brent += from->brent;
+	if (from->divergent > 0 &&
+	    (to->divergent == 0 || from->divergent_n < to->divergent_n))
+		to->divergent_n = from->divergent_n;
+	to->divergent += from->divergent;
+	for (i = 0; i < from->ncycles; ++i)
+		fwd_cycle(to, from->cycle[i]);
+}
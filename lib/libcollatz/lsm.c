@@ -0,0 +1,434 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <collatz/tree.h>
+#include <collatz/lsm.h>
+
+static interval *lsm_sort(interval *, interval *, size_t);
+static void lsm_run(run *, const interval *, size_t);
+static void lsm_merge(run *, run *, run *);
+static void lsm_push(lsm *, run *);
+static void lsm_update(lsm *);
+static void *lsm_compact(void *);
+
+/*
+ * Sort intervals by their first number with an LSD radix sort, one
+ * byte per pass, skipping the high bytes which are zero in every key.
+ * Uses b as scratch space and returns whichever of a and b holds the
+ * result.
+ */
+static interval *
+lsm_sort(interval *a, interval *b, size_t n)
+{
+	size_t count[256], pos, i;
+	uintmax_t max;
+	interval *t;
+	unsigned int shift, d;
+
+	for (max = 0, i = 0; i < n; ++i)
+		max |= a[i].first;
+	for (shift = 0; shift < sizeof max * 8 && (max >> shift) != 0;
+	    shift += 8) {
+		memset(count, 0, sizeof count);
+		for (i = 0; i < n; ++i)
+			count[(a[i].first >> shift) & 0xff]++;
+		for (pos = 0, d = 0; d < 256; ++d) {
+			i = count[d];
+			count[d] = pos;
+			pos += i;
+		}
+		for (i = 0; i < n; ++i)
+			b[count[(a[i].first >> shift) & 0xff]++] = a[i];
+		t = a;
+		a = b;
+		b = t;
+	}
+	return (a);
+}
+
+/*
+ * Coalesce sorted intervals into a run.
+ */
+static void
+lsm_run(run *r, const interval *iv, size_t n)
+{
+	interval *out;
+	size_t i, len;
+
+	if ((out = malloc(n * sizeof *out)) == NULL)
+		err(1, "malloc()");
+	r->covered = 0;
+	for (len = i = 0; i < n; ++i) {
+		if (len > 0 && iv[i].first <= out[len - 1].last + 1) {
+			if (iv[i].last > out[len - 1].last)
+				out[len - 1].last = iv[i].last;
+		} else {
+			out[len++] = iv[i];
+		}
+	}
+	for (i = 0; i < len; ++i)
+		r->covered += out[i].last - out[i].first + 1;
+	if ((r->iv = realloc(out, len * sizeof *out)) == NULL && len > 0)
+		err(1, "realloc()");
+	r->len = len;
+}
+
+/*
+ * Merge two runs into a third, coalescing intervals which overlap or
+ * are adjacent, and free the originals.
+ */
+static void
+lsm_merge(run *r, run *a, run *b)
+{
+	interval *out, iv;
+	size_t i, j, len;
+
+	if ((out = malloc((a->len + b->len) * sizeof *out)) == NULL)
+		err(1, "malloc()");
+	r->covered = 0;
+	for (len = i = j = 0; i < a->len || j < b->len; ) {
+		if (j == b->len ||
+		    (i < a->len && a->iv[i].first <= b->iv[j].first))
+			iv = a->iv[i++];
+		else
+			iv = b->iv[j++];
+		if (len > 0 && iv.first <= out[len - 1].last + 1) {
+			if (iv.last > out[len - 1].last) {
+				r->covered += iv.last - out[len - 1].last;
+				out[len - 1].last = iv.last;
+			}
+		} else {
+			r->covered += iv.last - iv.first + 1;
+			out[len++] = iv;
+		}
+	}
+	free(a->iv);
+	free(b->iv);
+	memset(a, 0, sizeof *a);
+	memset(b, 0, sizeof *b);
+	if ((r->iv = realloc(out, len * sizeof *out)) == NULL && len > 0)
+		err(1, "realloc()");
+	r->len = len;
+}
+
+/*
+ * Add a run to the stack, merging it with each occupied level in turn
+ * until it finds an empty one.
+ */
+static void
+lsm_push(lsm *s, run *r)
+{
+	run m;
+	unsigned int i;
+
+	for (i = 0; s->level[i].iv != NULL; ++i) {
+		assert(i + 1 < LSM_LEVELS);
+		lsm_merge(&m, &s->level[i], r);
+		*r = m;
+		atomic_fetch_add_explicit(&s->merges, 1, memory_order_relaxed);
+	}
+	s->level[i] = *r;
+}
+
+/*
+ * Recompute the coverage, the interval count and the frontier, i.e.
+ * the end of the range starting at 1, from the runs.  The frontier may
+ * be extended by intervals from any of them, so keep going around
+ * until none of them extend it.
+ */
+static void
+lsm_update(lsm *s)
+{
+	const run *r;
+	uintmax_t covered, intervals, proven;
+	size_t lo, hi, mid;
+	unsigned int i;
+	bool extended;
+
+	covered = intervals = 0;
+	for (i = 0; i < LSM_LEVELS; ++i) {
+		covered += s->level[i].covered;
+		intervals += s->level[i].len;
+	}
+	proven = atomic_load_explicit(&s->proven, memory_order_relaxed);
+	do {
+		extended = false;
+		for (i = 0; i < LSM_LEVELS; ++i) {
+			r = &s->level[i];
+			/* find the last interval starting at or before proven + 1 */
+			for (lo = 0, hi = r->len; lo < hi; ) {
+				mid = lo + (hi - lo) / 2;
+				if (r->iv[mid].first <= proven + 1)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			if (lo > 0 && r->iv[lo - 1].last > proven) {
+				proven = r->iv[lo - 1].last;
+				extended = true;
+			}
+		}
+	} while (extended);
+	atomic_store_explicit(&s->covered, covered, memory_order_relaxed);
+	atomic_store_explicit(&s->intervals, intervals, memory_order_relaxed);
+	atomic_store_explicit(&s->proven, proven, memory_order_relaxed);
+}
+
+/*
+ * Compactor thread: sort and coalesce each buffer handed to us, then
+ * merge the result into the stack.  The buffer is released as soon as
+ * it has been sorted, so the engine can refill it while we merge.
+ */
+static void *
+lsm_compact(void *arg)
+{
+	lsm *s = arg;
+	interval *sorted;
+	run r;
+
+	pthread_mutex_lock(&s->mtx);
+	for (;;) {
+		while (s->pending == NULL && !s->done)
+			pthread_cond_wait(&s->cv, &s->mtx);
+		if (s->pending == NULL)
+			break;
+		pthread_mutex_unlock(&s->mtx);
+		sorted = lsm_sort(s->pending, s->scratch, s->npending);
+		lsm_run(&r, sorted, s->npending);
+		pthread_mutex_lock(&s->mtx);
+		s->pending = NULL;
+		pthread_cond_broadcast(&s->cv);
+		pthread_mutex_unlock(&s->mtx);
+		lsm_push(s, &r);
+		lsm_update(s);
+		pthread_mutex_lock(&s->mtx);
+	}
+	pthread_mutex_unlock(&s->mtx);
+	return (NULL);
+}
+
+/*
+ * Start the compactor.
+ */
+static void
+lsm_start(lsm *s)
+{
+
+	s->done = false;
+	if ((errno = pthread_create(&s->thread, NULL, lsm_compact, s)) != 0)
+		err(1, "pthread_create()");
+	s->running = true;
+}
+
+/*
+ * Stop the compactor once it has dealt with whatever it was handed.
+ */
+static void
+lsm_stop(lsm *s)
+{
+
+	pthread_mutex_lock(&s->mtx);
+	s->done = true;
+	pthread_cond_broadcast(&s->cv);
+	pthread_mutex_unlock(&s->mtx);
+	if ((errno = pthread_join(s->thread, NULL)) != 0)
+		err(1, "pthread_join()");
+	s->running = false;
+}
+
+/*
+ * Initialize a recorder containing a single interval and start its
+ * compactor.
+ */
+void
+lsm_init(lsm *s, uintmax_t first, uintmax_t last)
+{
+	run r;
+	interval iv;
+
+	memset(s, 0, sizeof *s);
+	if ((s->buf[0] = malloc(LSM_BUFFER * sizeof *s->buf[0])) == NULL ||
+	    (s->buf[1] = malloc(LSM_BUFFER * sizeof *s->buf[1])) == NULL ||
+	    (s->scratch = malloc(LSM_BUFFER * sizeof *s->scratch)) == NULL)
+		err(1, "malloc()");
+	s->first = first;
+	s->last = s->highest = last;
+	iv.first = first;
+	iv.last = last;
+	lsm_run(&r, &iv, 1);
+	lsm_push(s, &r);
+	lsm_update(s);
+	node_bytes = sizeof(interval);
+	nodes = maxnodes = 1;
+	pthread_mutex_init(&s->mtx, NULL);
+	pthread_cond_init(&s->cv, NULL);
+	lsm_start(s);
+}
+
+/*
+ * Stop the compactor and free everything.
+ */
+void
+lsm_destroy(lsm *s)
+{
+	unsigned int i;
+
+	if (s->running)
+		lsm_stop(s);
+	pthread_cond_destroy(&s->cv);
+	pthread_mutex_destroy(&s->mtx);
+	for (i = 0; i < LSM_LEVELS; ++i)
+		free(s->level[i].iv);
+	free(s->buf[0]);
+	free(s->buf[1]);
+	free(s->scratch);
+	memset(s, 0, sizeof *s);
+	nodes = 0;
+}
+
+/*
+ * Hand the current buffer to the compactor and switch to the other,
+ * waiting for the compactor to finish with it first if necessary.
+ */
+void
+lsm_handoff(lsm *s)
+{
+
+	if (!s->running)
+		lsm_start(s);
+	pthread_mutex_lock(&s->mtx);
+	while (s->pending != NULL)
+		pthread_cond_wait(&s->cv, &s->mtx);
+	s->pending = s->buf[s->cur];
+	s->npending = s->len;
+	s->cur ^= 1;
+	s->len = 0;
+	pthread_cond_broadcast(&s->cv);
+	pthread_mutex_unlock(&s->mtx);
+}
+
+/*
+ * Hand over whatever is in the current buffer, stop the compactor once
+ * it is done with it, and merge all the runs into one, after which the
+ * statistics are exact and the recorder can be looked up and printed.
+ * Stopping the compactor lets performance counters inherited by it be
+ * folded into the caller's; the next handoff starts a new one.
+ */
+void
+lsm_flush(lsm *s)
+{
+	run r, m;
+	unsigned int i, top;
+
+	if (s->len > 0)
+		lsm_handoff(s);
+	if (s->running)
+		lsm_stop(s);
+	pthread_mutex_lock(&s->mtx);
+	memset(&r, 0, sizeof r);
+	for (i = top = 0; i < LSM_LEVELS; ++i) {
+		if (s->level[i].iv == NULL)
+			continue;
+		if (r.iv == NULL) {
+			r = s->level[i];
+			memset(&s->level[i], 0, sizeof s->level[i]);
+		} else {
+			lsm_merge(&m, &r, &s->level[i]);
+			r = m;
+			atomic_fetch_add_explicit(&s->merges, 1,
+			    memory_order_relaxed);
+		}
+		top = i;
+	}
+	s->level[top] = r;
+	lsm_update(s);
+	pthread_mutex_unlock(&s->mtx);
+	nodes = r.len;
+	if (nodes > maxnodes)
+		maxnodes = nodes;
+	if (top > maxdepth)
+		maxdepth = top;
+}
+
+/*
+ * Returns true if the specified number is in one of the runs.  Only
+ * numbers which have been flushed are seen.
+ */
+bool
+lsm_lookup(const lsm *s, uintmax_t num)
+{
+	const run *r;
+	size_t lo, hi, mid;
+	unsigned int i;
+
+	for (i = 0; i < LSM_LEVELS; ++i) {
+		r = &s->level[i];
+		for (lo = 0, hi = r->len; lo < hi; ) {
+			mid = lo + (hi - lo) / 2;
+			if (r->iv[mid].first <= num)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		if (lo > 0 && num <= r->iv[lo - 1].last)
+			return (true);
+	}
+	return (false);
+}
+
+/*
+ * Print out the runs.  After lsm_flush(), there is only one, so the
+ * output is in order.
+ */
+void
+lsm_fprint(FILE *f, const lsm *s)
+{
+	const run *r;
+	size_t j;
+	unsigned int i;
+
+	for (i = 0; i < LSM_LEVELS; ++i) {
+		r = &s->level[i];
+		for (j = 0; j < r->len; ++j)
+			fprintf(f, "[%ju, %ju]\n", r->iv[j].first,
+			    r->iv[j].last);
+	}
+}
@@ -0,0 +1,63 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <collatz/map.h>
+
+/*
+ * Parse a map of the form "qn+r".  Returns 0 on success and -1 with
+ * errno set to EINVAL if the string is malformed or q or r is even, q
+ * is less than 3 or greater than MAP_Q_MAX, or r is greater than
+ * MAP_R_MAX.
+ */
+int
+map_parse(map *m, const char *str)
+{
+	unsigned long q, r;
+	char *e;
+
+	q = strtoul(str, &e, 10);
+	if (e == str || *e++ != 'n' || *e++ != '+' || *e < '0' || *e > '9')
+		goto fail;
+	r = strtoul(e, &e, 10);
+	if (*e != '\0' || q < 3 || q > MAP_Q_MAX || q % 2 == 0 ||
+	    r % 2 == 0 || r > MAP_R_MAX)
+		goto fail;
+	m->q = q;
+	m->r = r;
+	return (0);
+fail:
+	errno = EINVAL;
+	return (-1);
+}
@@ -0,0 +1,152 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <collatz/mp.h>
+
+static void
+mp_from_u128(mp *x, unsigned __int128 y)
+{
+
+	memset(x, 0, sizeof *x);
+	x->limb[0] = (uint64_t)y;
+	x->limb[1] = (uint64_t)(y >> 64);
+	x->len = x->limb[1] ? 2 : 1;
+}
+
+/*
+ * Number of significant bits.
+ */
+static unsigned int
+mp_bits(const mp *x)
+{
+	uint64_t top;
+
+	top = x->limb[x->len - 1];
+	return ((x->len - 1) * 64 + (top ? 64 - __builtin_clzll(top) : 0));
+}
+
+/*
+ * Apply T: x / 2 if x is even, (qx + r) / 2 if it is odd.  Returns 1
+ * for an odd step, 0 for an even step, or -1 if the result would not
+ * fit.
+ */
+static int
+mp_step(mp *x, unsigned int q, unsigned int r)
+{
+	unsigned __int128 t;
+	uint64_t carry;
+	unsigned int i;
+	bool odd;
+
+	odd = x->limb[0] & 1;
+	if (odd) {
+		for (carry = r, i = 0; i < x->len; ++i) {
+			t = (unsigned __int128)x->limb[i] * q + carry;
+			x->limb[i] = (uint64_t)t;
+			carry = (uint64_t)(t >> 64);
+		}
+		if (carry) {
+			if (x->len == MP_LIMBS)
+				return (-1);
+			x->limb[x->len++] = carry;
+		}
+	}
+	for (i = 0; i < x->len; ++i)
+		x->limb[i] = x->limb[i] >> 1 |
+		    (i + 1 < x->len ? x->limb[i + 1] << 63 : 0);
+	if (x->len > 1 && x->limb[x->len - 1] == 0)
+		x->len--;
+	return (odd);
+}
+
+/*
+ * Follow the trajectory of *y under the map qn + r, which must be
+ * nonzero, for at least one step and until it drops below 2^bits, and
+ * store the value it dropped to back into *y.  The number of steps taken
+ * and how many of them were odd are added to *steps and *odd.  Returns 0
+ * on success and -1 if the trajectory outgrew MP_BITS bits or, if limit
+ * is not 0, took more than limit steps, in which case it presumably
+ * diverges.
+ */
+int
+mp_descend(unsigned __int128 *y, unsigned int q, unsigned int r,
+    unsigned int bits, uintmax_t limit, uintmax_t *steps, uintmax_t *odd)
+{
+	uintmax_t n;
+	mp x;
+	int ret;
+
+	mp_from_u128(&x, *y);
+	n = 0;
+	do {
+		if (limit > 0 && n++ >= limit)
+			return (-1);
+		if ((ret = mp_step(&x, q, r)) < 0)
+			return (-1);
+		*steps += 1;
+		*odd += ret;
+	} while (mp_bits(&x) > bits);
+	*y = (unsigned __int128)x.limb[1] << 64 | x.limb[0];
+	return (0);
+}
+
+/*
+ * Like mp_descend(), but keep track of the highest value reached instead
+ * of the number of steps, raising *peak if it is exceeded.  Returns -1
+ * if the trajectory outgrew MP_BITS bits or the peak does not fit in 128
+ * bits.
+ */
+int
+mp_peak(unsigned __int128 *y, unsigned int q, unsigned int r,
+    unsigned int bits, unsigned __int128 *peak)
+{
+	unsigned __int128 v;
+	mp x;
+	int ret;
+
+	mp_from_u128(&x, *y);
+	do {
+		if ((ret = mp_step(&x, q, r)) < 0)
+			return (-1);
+		if (ret == 0)
+			continue;
+		if (mp_bits(&x) > 128)
+			return (-1);
+		v = (unsigned __int128)x.limb[1] << 64 | x.limb[0];
+		if (v > *peak)
+			*peak = v;
+	} while (mp_bits(&x) > bits);
+	*y = (unsigned __int128)x.limb[1] << 64 | x.limb[0];
+	return (0);
+}
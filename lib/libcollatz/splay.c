@@ -0,0 +1,302 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+
+#include <assert.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <collatz/tree.h>
+#include <collatz/splay.h>
+
+#define debug(...) \
+	do { if (tree_debug) fprintf(stderr, __VA_ARGS__); } while (0)
+
+static snode *splay_create(splay *, uintmax_t, uintmax_t);
+static void splay_free(splay *, snode *);
+static snode *splay_to(snode *, uintmax_t);
+
+/*
+ * Allocate an interval and account for it.
+ */
+static snode *
+splay_create(splay *s, uintmax_t first, uintmax_t last)
+{
+	snode *n;
+
+	debug("creating [%ju, %ju]\n", first, last);
+	if ((n = calloc(1, sizeof *n)) == NULL)
+		err(1, "calloc()");
+#if HAVE_MALLOC_USABLE_SIZE
+	/* account for the allocator's size classes and chunk header */
+	if (nodes == 0)
+		node_bytes = malloc_usable_size(n) + sizeof(size_t);
+#else
+	if (nodes == 0)
+		node_bytes = sizeof *n;
+#endif
+	n->first = first;
+	n->last = last;
+	s->covered += last - first + 1;
+	if (last > s->highest)
+		s->highest = last;
+	if (first == 1)
+		s->proven = last;
+	if (++nodes > maxnodes)
+		maxnodes = nodes;
+	return (n);
+}
+
+/*
+ * Free an interval which has been unlinked from the tree.
+ */
+static void
+splay_free(splay *s, snode *n)
+{
+
+	debug("absorbing [%ju, %ju]\n", n->first, n->last);
+	s->covered -= n->last - n->first + 1;
+	nodes--;
+	free(n);
+}
+
+/*
+ * Top-down splay: rearrange the tree so that its root is the interval
+ * starting at key if there is one, otherwise the last interval on the
+ * search path, i.e. the predecessor or successor of key.  In the
+ * latter case, everything in the root's left subtree starts before key
+ * and everything in its right subtree after it.
+ */
+static snode *
+splay_to(snode *t, uintmax_t key)
+{
+	snode head, *l, *r, *y;
+	unsigned int depth;
+
+	if (t == NULL)
+		return (NULL);
+	head.left = head.right = NULL;
+	l = r = &head;
+	for (depth = 0; ; ++depth) {
+		if (key < t->first) {
+			if (t->left == NULL)
+				break;
+			if (key < t->left->first) {
+				/* zig-zig: rotate right */
+				y = t->left;
+				t->left = y->right;
+				y->right = t;
+				t = y;
+				depth++;
+				if (t->left == NULL)
+					break;
+			}
+			/* link right */
+			r->left = t;
+			r = t;
+			t = t->left;
+		} else if (key > t->first) {
+			if (t->right == NULL)
+				break;
+			if (key > t->right->first) {
+				/* zig-zig: rotate left */
+				y = t->right;
+				t->right = y->left;
+				y->left = t;
+				t = y;
+				depth++;
+				if (t->right == NULL)
+					break;
+			}
+			/* link left */
+			l->right = t;
+			l = t;
+			t = t->right;
+		} else {
+			break;
+		}
+	}
+	/* reassemble */
+	l->right = t->left;
+	r->left = t->right;
+	t->left = head.right;
+	t->right = head.left;
+	if (depth > maxdepth)
+		maxdepth = depth;
+	return (t);
+}
+
+/*
+ * Initialize a set containing a single interval.
+ */
+void
+splay_init(splay *s, uintmax_t first, uintmax_t last)
+{
+
+	s->covered = s->highest = s->proven = 0;
+	s->root = splay_create(s, first, last);
+}
+
+/*
+ * Destroy the set.  Rotating left children up turns the tree into a
+ * list as we go, so this needs neither recursion nor a stack, however
+ * unbalanced the tree is.
+ */
+void
+splay_destroy(splay *s)
+{
+	snode *n, *y;
+
+	n = s->root;
+	while (n != NULL) {
+		if ((y = n->left) != NULL) {
+			n->left = y->right;
+			y->right = n;
+			n = y;
+		} else {
+			y = n->right;
+			splay_free(s, n);
+			n = y;
+		}
+	}
+	s->root = NULL;
+}
+
+/*
+ * Insert a range, merging it with every interval it overlaps with or
+ * is adjacent to.  The result ends up at the root.
+ *
+ * Returns true if the entire range was already in the set.
+ */
+bool
+splay_insert(splay *s, uintmax_t first, uintmax_t last)
+{
+	snode *l, *r, *n;
+
+	assert(first <= last);
+	assert(s->root != NULL);
+	debug("inserting [%ju, %ju]\n", first, last);
+
+	/* split into the intervals which start at or before us, and the rest */
+	s->root = splay_to(s->root, first);
+	if (s->root->first <= first) {
+		l = s->root;
+		r = l->right;
+		l->right = NULL;
+	} else {
+		r = s->root;
+		l = r->left;
+		r->left = NULL;
+		/* bring our predecessor to the root of the left part */
+		l = splay_to(l, first);
+	}
+
+	/* merge with our predecessor */
+	if (l != NULL && last <= l->last) {
+		/* already covered */
+		l->right = r;
+		s->root = l;
+		return (true);
+	}
+	if (l != NULL && l->last + 1 >= first) {
+		first = l->first;
+		n = l;
+		l = l->left;
+		splay_free(s, n);
+	}
+
+	/* merge with our successors */
+	while ((r = splay_to(r, first)) != NULL && r->first - 1 <= last) {
+		assert(r->left == NULL);
+		if (r->last > last)
+			last = r->last;
+		n = r;
+		r = r->right;
+		splay_free(s, n);
+	}
+
+	n = splay_create(s, first, last);
+	n->left = l;
+	n->right = r;
+	s->root = n;
+	return (false);
+}
+
+/*
+ * Returns true if the specified number is contained in the set.
+ */
+bool
+splay_lookup(splay *s, uintmax_t num)
+{
+	snode *n;
+
+	if ((n = s->root = splay_to(s->root, num)) == NULL)
+		return (false);
+	if (n->first <= num)
+		return (num <= n->last);
+	if (n->left == NULL)
+		return (false);
+	n->left = splay_to(n->left, num);
+	return (num <= n->left->last);
+}
+
+/*
+ * Print out the set in order, using an explicit stack since the tree
+ * may be arbitrarily deep.
+ */
+void
+splay_fprint(FILE *f, const splay *s)
+{
+	const snode *n, **stack, **ns;
+	size_t depth, size;
+
+	stack = NULL;
+	depth = size = 0;
+	for (n = s->root; n != NULL || depth > 0; n = n->right) {
+		for (; n != NULL; n = n->left) {
+			if (depth == size) {
+				size = size ? size * 2 : 64;
+				if ((ns = realloc(stack, size * sizeof *ns)) == NULL)
+					err(1, "realloc()");
+				stack = ns;
+			}
+			stack[depth++] = n;
+		}
+		n = stack[--depth];
+		fprintf(f, "[%ju, %ju]\n", n->first, n->last);
+	}
+	free(stack);
+}
@@ -0,0 +1,485 @@
+/*-
+ * Copyright (c) 2017 Dag-Erling Smørgrav
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#if HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#if HAVE_MALLOC_H
+#include <malloc.h>
+#endif
+
+#include <assert.h>
+#include <err.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <collatz/tree.h>
+
+#define debug(...) \
+	do { if (tree_debug) fprintf(stderr, __VA_ARGS__); } while (0)
+
+bool tree_debug;
+node *proven;
+unsigned int nodes, maxnodes, maxdepth;
+size_t node_bytes = sizeof(node);
+
+const char *outcome_name[INS_NOUTCOMES] = {
+	"trivial", "subrange", "expand", "split", "coalesce", "absorb",
+	"left", "right", "shallow",
+};
+uintmax_t inshist[INS_NOUTCOMES][DEPTH_BUCKETS];
+#define INSTAT(o, d) \
+	inshist[o][(d) == 0 ? 0 : DEPTH_BUCKETS - __builtin_clz(d) - 1]++
+
+static void remove_edge(node **, bool, uintmax_t *, uintmax_t *);
+static bool insert_into_leaf(node *, uintmax_t, uintmax_t);
+static bool insert_into_internal(node *, uintmax_t, uintmax_t);
+
+/*
+ * Print out the tree.
+ */
+void
+fprintnodes(FILE *f, const node *n)
+{
+
+	if (n->left == NULL && n->right == NULL)
+		fprintf(f, "[%ju, %ju]\n", n->first, n->last);
+	if (n->left != NULL)
+		fprintnodes(f, n->left);
+	if (n->right != NULL)
+		fprintnodes(f, n->right);
+}
+
+/*
+ * Create a leaf node.
+ */
+node *
+create(unsigned int depth, uintmax_t first, uintmax_t last)
+{
+	node *n;
+
+	debug("%6u creating [%ju, %ju]\n", depth, first, last);
+	if ((n = calloc(1, sizeof *n)) == NULL)
+		err(1, "calloc()");
+#if HAVE_MALLOC_USABLE_SIZE
+	/* account for the allocator's size classes and chunk header */
+	if (nodes == 0)
+		node_bytes = malloc_usable_size(n) + sizeof(size_t);
+#endif
+	n->covered = (n->last = last) - (n->first = first) + 1;
+	if ((n->depth = depth) > maxdepth)
+		maxdepth = depth;
+	if (++nodes > maxnodes)
+		maxnodes = nodes;
+	if (first == 1)
+		proven = n;
+	return (n);
+}
+
+/*
+ * Destroy a node.
+ */
+void
+destroy(node *n)
+{
+
+	if (n == NULL)
+		return;
+	destroy(n->left);
+	destroy(n->right);
+	debug("%6u destroying [%ju, %ju]\n", n->depth, n->first, n->last);
+	nodes--;
+	free(n);
+}
+
+/*
+ * Remove the leftmost or rightmost leaf of a subtree and return its
+ * range.  If the subtree consisted of a single leaf, *np is set to NULL.
+ * A node which is left with a single child is replaced by that child,
+ * which keeps its depth; since depth is only used to balance the tree,
+ * this is harmless.
+ */
+static void
+remove_edge(node **np, bool rightmost, uintmax_t *first, uintmax_t *last)
+{
+	node *n, *c;
+
+	n = *np;
+	if (LEAF_NODE(n)) {
+		*first = n->first;
+		*last = n->last;
+		destroy(n);
+		*np = NULL;
+		return;
+	}
+	remove_edge(rightmost ? &n->right : &n->left, rightmost, first, last);
+	if (n->left == NULL || n->right == NULL) {
+		c = n->left != NULL ? n->left : n->right;
+		n->left = n->right = NULL;
+		destroy(n);
+		*np = c;
+		return;
+	}
+	n->first = n->left->first;
+	n->last = n->right->last;
+	n->covered = n->left->covered + n->right->covered;
+}
+
+/*
+ * Insert a range into a leaf node.
+ *
+ * Possible cases: the new range...
+ * ...is a sub-range of this node
+ * ...covers this node entirely
+ * ...is left-adjacent to this node
+ * ...is right-adjacent to this node
+ * ...sits to the left of this node
+ * ...sits to the right of this node
+ *
+ * Returns true if the entire range was already in the tree.
+ */
+static bool
+insert_into_leaf(node *n, uintmax_t first, uintmax_t last)
+{
+
+	assert(n->left == NULL && n->right == NULL);
+
+	/* cases where we remain a leaf */
+	if (first >= n->first && last <= n->last) {
+		/* sub-range */
+		INSTAT(INS_SUBRANGE, n->depth);
+		return (true);
+	} else if (first <= n->last + 1 && last >= n->first - 1) {
+		/* overlaps with or adjacent to us */
+		INSTAT(INS_EXPAND, n->depth);
+		debug("%6u expanding [%ju, %ju] to [%ju, %ju]\n",
+		    n->depth, n->first, n->last, first, last);
+		if (first < n->first)
+			n->first = first;
+		if (last > n->last)
+			n->last = last;
+		n->covered = n->last - n->first + 1;
+		if (n->first == 1)
+			proven = n;
+		return (false);
+	}
+
+	/* cases where we split into child nodes */
+	INSTAT(INS_SPLIT, n->depth);
+	if (last < n->first - 1) {
+		/* sits to the left */
+		debug("%6u splitting into [%ju, %ju] and [%ju, %ju]\n",
+		    n->depth, first, last, n->first, n->last);
+		n->left = create(n->depth + 1, first, last);
+		n->right = create(n->depth + 1, n->first, n->last);
+	} else if (first > n->last + 1) {
+		/* sits to the right */
+		debug("%6u splitting into [%ju, %ju] and [%ju, %ju]\n",
+		    n->depth, n->first, n->last, first, last);
+		n->left = create(n->depth + 1, n->first, n->last);
+		n->right = create(n->depth + 1, first, last);
+	} else {
+		assert(0);
+	}
+	n->first = n->left->first;
+	n->last = n->right->last;
+	n->covered = n->left->covered + n->right->covered;
+	return (false);
+}
+
+/*
+ * Insert a range into an internal node.
+ *
+ * Possible cases: the new range...
+ * ...overlaps with or is adjacent to one of this node's children
+ * ...overlaps with or is adjacent to both of this node's children
+ * ...sits to the left of this node
+ * ...sits to the right of this node
+ * ...sits between this node's children
+ *
+ * Returns true if the entire range was already in the tree.
+ */
+static bool
+insert_into_internal(node *n, uintmax_t first, uintmax_t last)
+{
+	uintmax_t f, l;
+	bool found;
+
+	assert(n->left != NULL && n->right != NULL);
+
+	/* cases where we bridge the gap between our children */
+	if (first <= n->left->last + 1 && last >= n->right->first - 1) {
+		/* overlaps with or adjacent to both children */
+		INSTAT(INS_COALESCE, n->depth);
+		debug("%6u bridging [%ju, %ju] and [%ju, %ju] with [%ju, %ju]\n",
+		    n->depth, n->left->first, n->left->last,
+		    n->right->first, n->right->last, first, last);
+		/*
+		 * Absorb every leaf which overlaps with or is adjacent to
+		 * the new range.  Only the leaves at the inner edges of
+		 * our children can be affected, unless the new range
+		 * extends past them.
+		 */
+		while (n->left != NULL && n->left->last + 1 >= first) {
+			INSTAT(INS_ABSORB, n->depth);
+			remove_edge(&n->left, true, &f, &l);
+			if (f < first)
+				first = f;
+		}
+		while (n->right != NULL && n->right->first - 1 <= last) {
+			INSTAT(INS_ABSORB, n->depth);
+			remove_edge(&n->right, false, &f, &l);
+			if (l > last)
+				last = l;
+		}
+		if (n->left == NULL && n->right == NULL) {
+			/* nothing left, we become a leaf */
+			debug("%6u coalescing into [%ju, %ju]\n",
+			    n->depth, first, last);
+			n->first = first;
+			n->last = last;
+			n->covered = n->last - n->first + 1;
+			if (n->first == 1)
+				proven = n;
+			return (false);
+		}
+		/* the merged range now sits to one side of or between them */
+		if (n->left == NULL)
+			n->left = create(n->depth + 1, first, last);
+		else if (n->right == NULL)
+			n->right = create(n->depth + 1, first, last);
+		else if (n->left->depth < n->right->depth)
+			(void)insert(n->left, first, last);
+		else
+			(void)insert(n->right, first, last);
+		n->first = n->left->first;
+		n->last = n->right->last;
+		n->covered = n->left->covered + n->right->covered;
+		return (false);
+	}
+
+	/* cases where we descend into our children */
+	if (first > n->left->last + 1 && last < n->right->first - 1) {
+		/* sits between them, pass it to the shallowest one */
+		INSTAT(INS_SHALLOW, n->depth);
+		if (n->left->depth < n->right->depth)
+			found = insert(n->left, first, last);
+		else
+			found = insert(n->right, first, last);
+	} else if (last < n->right->first - 1) {
+		/* overlaps with, adjacent to or left of left child */
+		INSTAT(INS_LEFT, n->depth);
+		found = insert(n->left, first, last);
+	} else if (first > n->left->last + 1) {
+		/* overlaps with, adjacent to or right of right child */
+		INSTAT(INS_RIGHT, n->depth);
+		found = insert(n->right, first, last);
+	} else {
+		assert(0);
+	}
+	if (!found) {
+		n->first = n->left->first;
+		n->last = n->right->last;
+		n->covered = n->left->covered + n->right->covered;
+	}
+	return (found);
+}
+
+/*
+ * Dispatch to correct insert function depending on leafiness.
+ */
+bool
+insert(node *n, uintmax_t first, uintmax_t last)
+{
+	bool found;
+
+	assert(first <= last);
+	assert((n->left == NULL) == (n->right == NULL));
+	assert(n->left == NULL || n->first == n->left->first);
+	assert(n->right == NULL || n->last == n->right->last);
+	if ((first == last && (first == n->first || last == n->last)) ||
+	    (LEAF_NODE(n) && first == n->first && last == n->last)) {
+		/* trivial cases */
+		INSTAT(INS_TRIVIAL, n->depth);
+		found = true;
+	} else {
+		/* do it the hard way */
+		debug("%6u inserting [%ju, %ju] into [%ju, %ju]\n",
+		    n->depth, first, last, n->first, n->last);
+		found = LEAF_NODE(n) ? insert_into_leaf(n, first, last) :
+		    insert_into_internal(n, first, last);
+	}
+	if (found) {
+		/* range was already covered */
+		debug("%6u found [%ju, %ju] in [%ju, %ju]\n",
+		    n->depth, first, last, n->first, n->last);
+	} else {
+		/* range was inserted, adjust coverage etc. */
+		if (LEAF_NODE(n)) {
+			n->covered = n->last - n->first + 1;
+		} else {
+			n->first = n->left->first;
+			n->last = n->right->last;
+			n->covered = n->left->covered + n->right->covered;
+		}
+	}
+	return (found);
+}
+
+/*
+ * Insert a range, starting from the deepest node on the finger's path
+ * which contains it instead of from the root.  Such a node's range does
+ * not change, so neither do those of its ancestors, and all we need to
+ * do for them is adjust their coverage.  The finger is then extended
+ * down to the leaf which now holds the start of the range.
+ *
+ * The finger is only valid as long as every insert into the tree goes
+ * through it.
+ */
+bool
+finger_insert(finger *fg, node *root, uintmax_t first, uintmax_t last)
+{
+	node *n, **path;
+	uintmax_t covered;
+	unsigned int i;
+	bool found;
+
+	for (i = fg->len; i > 0; --i) {
+		n = fg->path[i - 1];
+		if (first >= n->first && last <= n->last)
+			break;
+	}
+	if (i > 0) {
+		fg->len = i - 1;
+		n = fg->path[fg->len];
+		if (fg->len > 0)
+			fg->hits++;
+	} else {
+		fg->len = 0;
+		n = root;
+	}
+	covered = n->covered;
+	if (!(found = insert(n, first, last))) {
+		for (i = 0; i < fg->len; ++i)
+			fg->path[i]->covered += n->covered - covered;
+	}
+	for (;;) {
+		if (fg->len == fg->size) {
+			fg->size = fg->size ? fg->size * 2 : 64;
+			if ((path = realloc(fg->path,
+			    fg->size * sizeof *path)) == NULL)
+				err(1, "realloc()");
+			fg->path = path;
+		}
+		fg->path[fg->len++] = n;
+		if (LEAF_NODE(n))
+			break;
+		n = first <= n->left->last ? n->left : n->right;
+	}
+	return (found);
+}
+
+/*
+ * Release the finger's path.
+ */
+void
+finger_free(finger *fg)
+{
+
+	free(fg->path);
+	fg->path = NULL;
+	fg->len = fg->size = 0;
+}
+
+/*
+ * Returns true if the specified number is contained in the tree.
+ */
+bool
+lookup(const node *n, uintmax_t num)
+{
+
+	if (LEAF_NODE(n))
+		return (num >= n->first && num <= n->last);
+	else if (num >= n->left->first && num <= n->left->last)
+		return (lookup(n->left, num));
+	else if (num >= n->right->first && num <= n->right->last)
+		return (lookup(n->right, num));
+	else
+		return (false);
+}
+
+/*
+ * Look up a batch of numbers, setting found[i] if num[i] is contained in
+ * the tree.  Rather than complete one descent before starting the next,
+ * we advance all of them by one level per round and prefetch the
+ * children of the nodes they are about to visit, so that the cache
+ * misses of independent descents are taken in parallel.
+ */
+void
+lookup_batch(const node *root, const uintmax_t *num, bool *found,
+    unsigned int count)
+{
+	const node *cur[LOOKUP_BATCH_MAX], *n;
+	unsigned int i, active;
+
+	assert(count <= LOOKUP_BATCH_MAX);
+	for (i = 0; i < count; ++i)
+		cur[i] = root;
+	if (!LEAF_NODE(root)) {
+		__builtin_prefetch(root->left);
+		__builtin_prefetch(root->right);
+	}
+	for (active = count; active > 0; ) {
+		for (active = i = 0; i < count; ++i) {
+			if ((n = cur[i]) == NULL)
+				continue;
+			if (LEAF_NODE(n)) {
+				found[i] = num[i] >= n->first && num[i] <= n->last;
+				cur[i] = NULL;
+				continue;
+			}
+			/* both children were prefetched in the previous round */
+			if (num[i] >= n->left->first && num[i] <= n->left->last)
+				n = n->left;
+			else if (num[i] >= n->right->first && num[i] <= n->right->last)
+				n = n->right;
+			else {
+				found[i] = false;
+				cur[i] = NULL;
+				continue;
+			}
+			if (!LEAF_NODE(n)) {
+				__builtin_prefetch(n->left);
+				__builtin_prefetch(n->right);
+			}
+			cur[i] = n;
+			active++;
+		}
+	}
+}